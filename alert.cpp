@@ -0,0 +1,118 @@
+// $Id$
+/**
+ * @file alert.cpp
+ * @brief Open door alert rules
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "alert.h"
+
+void c_alerts::f_addRule(alertType n_type, const char* s_event, uint16_t* p_param, uint16_t* p_param2) {
+    if (n_rules == ALERT_MAXRULES)
+        return;
+    alertRule* a_rule = &a_rules[n_rules++];
+    a_rule->n_type = n_type;
+    a_rule->s_event = s_event;
+    a_rule->p_param = p_param;
+    a_rule->p_param2 = p_param2;
+    a_rule->n_deadline = ALERT_NEVER;
+    a_rule->n_fired = 0;
+}
+
+void c_alerts::f_setState(bool b_doorOpen, uint32_t n_stateSince) {
+    b_open = b_doorOpen;
+    n_since = n_stateSince;
+    if (!b_open)
+        for (uint8_t n_rule = 0; n_rule < n_rules; n_rule++)
+            a_rules[n_rule].n_fired = 0;
+}
+
+void c_alerts::f_refresh(uint32_t n_now) {
+    for (uint8_t n_rule = 0; n_rule < n_rules; n_rule++)
+        a_rules[n_rule].n_deadline = f_deadline(&a_rules[n_rule], n_now);
+}
+
+/**
+ * Works out when the rule fires next
+ * @return Wall clock of the deadline or ALERT_NEVER
+ */
+uint32_t c_alerts::f_deadline(alertRule* a_rule, uint32_t n_now) {
+    if (!b_open)
+        return ALERT_NEVER;
+
+    switch (a_rule->n_type) {
+        case ALERT_OPENFOR:
+            if (a_rule->n_fired || !*a_rule->p_param)
+                return ALERT_NEVER;
+            return n_since + *a_rule->p_param;
+
+        case ALERT_WINDOW: {
+            uint16_t n_start = *a_rule->p_param;
+            uint16_t n_end = *a_rule->p_param2;
+            if (a_rule->n_fired || n_start == n_end)
+                return ALERT_NEVER;
+            uint16_t n_minute = Time.hour() * 60 + Time.minute();
+            if (f_inWindow(n_minute, n_start, n_end))
+                return n_now;
+            return n_now + (n_start + 24*60 - n_minute) % (24*60) * 60 - Time.second();
+        }
+
+        case ALERT_REMINDER: {
+            if (!*a_rule->p_param)
+                return ALERT_NEVER;
+            // first reminder one interval after the start, then every
+            // interval after the last one fired
+            uint32_t n_start = n_since + (a_rule->p_param2 ? *a_rule->p_param2 : 0);
+            uint32_t n_after = a_rule->n_fired > n_start ? a_rule->n_fired : n_start;
+            return n_start + ((n_after - n_start) / *a_rule->p_param + 1) * *a_rule->p_param;
+        }
+    }
+    return ALERT_NEVER;
+}
+
+/**
+ * Checks minute of day against window, window may cross midnight
+ */
+bool c_alerts::f_inWindow(uint16_t n_minute, uint16_t n_start, uint16_t n_end) {
+    if (n_start > n_end)
+        return n_minute >= n_start || n_minute <= n_end;
+    return n_minute >= n_start && n_minute <= n_end;
+}
+
+int8_t c_alerts::f_due(uint32_t n_now) {
+    for (uint8_t n_rule = 0; n_rule < n_rules; n_rule++) {
+        alertRule* a_rule = &a_rules[n_rule];
+        if (a_rule->n_deadline == ALERT_NEVER || (int32_t)(n_now - a_rule->n_deadline) < 0)
+            continue;
+        a_rule->n_fired = n_now;
+        a_rule->n_deadline = f_deadline(a_rule, n_now);
+        return n_rule;
+    }
+    return -1;
+}
+
+uint32_t c_alerts::f_getDelay(uint32_t n_now) {
+    uint32_t n_delay = ALERT_NEVER;
+    for (uint8_t n_rule = 0; n_rule < n_rules; n_rule++) {
+        if (a_rules[n_rule].n_deadline == ALERT_NEVER)
+            continue;
+        int32_t n_left = a_rules[n_rule].n_deadline - n_now;
+        if (n_left < 0)
+            n_left = 0;
+        if ((uint32_t)n_left < n_delay)
+            n_delay = n_left;
+    }
+    if (n_delay != ALERT_NEVER && n_delay > ALERT_MAXDELAY)
+        n_delay = ALERT_MAXDELAY;
+    return n_delay;
+}
+
+alertType c_alerts::f_getType(uint8_t n_rule) {
+    return a_rules[n_rule].n_type;
+}
+
+const char* c_alerts::f_getEvent(uint8_t n_rule) {
+    return a_rules[n_rule].s_event;
+}
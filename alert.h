@@ -0,0 +1,100 @@
+// $Id$
+/**
+ * @file alert.h
+ * @brief Open door alert rules
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Each rule works out when it fires next from the door state, the time the
+ * state was entered and its configuration. Deadlines are recalculated only
+ * when the state or configuration changes and when a deadline is reached,
+ * so nothing is evaluated between them. All rules are reset once the door
+ * is closed.
+ */
+// $Log$
+
+#ifndef ALERT_H
+#define ALERT_H
+
+#include "application.h"
+#include "global.h"
+
+// maximum number of rules per door
+#define ALERT_MAXRULES 4
+// longest time between deadline recalculations (S), picks up wall clock
+// adjustments for time window rules
+#define ALERT_MAXDELAY 3600
+// no deadline
+#define ALERT_NEVER 0xFFFFFFFF
+
+enum alertType {
+    // door open for longer than parameter (S)
+    ALERT_OPENFOR,
+    // door open during daily window, parameters are start and end (minutes)
+    ALERT_WINDOW,
+    // repeats every parameter (S) while open, starting after second
+    // parameter (S) if set
+    ALERT_REMINDER
+};
+
+class c_alerts {
+
+    typedef struct {
+        alertType n_type;
+        const char* s_event;
+        uint16_t* p_param;
+        uint16_t* p_param2;
+        uint32_t n_deadline;
+        uint32_t n_fired;
+    } alertRule;
+
+protected:
+    alertRule a_rules[ALERT_MAXRULES];
+    uint8_t n_rules = 0;
+    bool b_open = false;
+    uint32_t n_since = 0;
+
+    uint32_t f_deadline(alertRule* a_rule, uint32_t n_now);
+    static bool f_inWindow(uint16_t n_minute, uint16_t n_start, uint16_t n_end);
+
+public:
+
+/**
+ * Adds rule, parameters point to configuration values so changes apply
+ * @param[in] alertType n_type Rule type
+ * @param[in] const char* s_event Event published when the rule fires
+ * @param[in] uint16_t* p_param Rule parameter, 0 disables duration rules
+ * @param[in] uint16_t* p_param2 Second parameter if the type has one,
+ *  equal window start and end disable window rule
+ */
+    void f_addRule(alertType n_type, const char* s_event, uint16_t* p_param, uint16_t* p_param2 = NULL);
+
+/**
+ * Updates door state, rules are reset when the door is closed
+ * @param[in] bool b_doorOpen Door is not closed
+ * @param[in] uint32_t n_stateSince Wall clock of the last state change
+ */
+    void f_setState(bool b_doorOpen, uint32_t n_stateSince);
+
+/**
+ * Recalculates all deadlines
+ */
+    void f_refresh(uint32_t n_now);
+
+/**
+ * Finds rule with deadline reached and marks it fired
+ * @return rule index or -1 if none is due
+ */
+    int8_t f_due(uint32_t n_now);
+
+/**
+ * Reports time until the earliest deadline
+ * @return Seconds, capped to ALERT_MAXDELAY, or ALERT_NEVER
+ */
+    uint32_t f_getDelay(uint32_t n_now);
+
+    alertType f_getType(uint8_t n_rule);
+    const char* f_getEvent(uint8_t n_rule);
+};
+
+#endif
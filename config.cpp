@@ -9,95 +9,364 @@
 
 #include "config.h"
 
+/**
+* Configuration schema, adding a field takes one line here plus the member
+* in configStruct. Values outside of min..max are replaced with the default.
+*/
+const c_config::configField c_config::a_fields[] = {
+ CONFIG_FIELD("rdt", n_readTime, 200, 60000, DEFAULT_READTIME),
+ CONFIG_FIELD("rdf", n_readFast, 100, 60000, DEFAULT_READFAST),
+ CONFIG_FIELD("mtt", n_motionTime, 500, 10000, DEFAULT_MOTIONTIME),
+ CONFIG_FIELD("rlt", n_relayTime, 10, 2000, DEFAULT_RELAYTIME),
+ CONFIG_FIELD("rlp", n_relayPause, 10, 5000, DEFAULT_RELAYPAUSE),
+ CONFIG_FIELD("srr", n_sensorReads, 1, 20, DEFAULT_SENSORREADS),
+ CONFIG_FIELD("srt", n_sensorThreshold, 1, 80, DEFAULT_SENSORTRESHOLD),
+ CONFIG_FIELD("srs", n_sensorSequential, 0, 1, DEFAULT_SENSORSEQUENTIAL),
+ CONFIG_FIELD("sgt", n_signalTime, 1, 3600, DEFAULT_SIGNALTIME),
+ CONFIG_FIELD("aot", n_alertOpenTimeout, 0, 65535, DEFAULT_ALERTOPENTIMEOUT),
+ CONFIG_FIELD("aor", n_alertOpenReminder, 0, 65535, DEFAULT_ALERTOPENREMINDER),
+ CONFIG_FIELD("ans", n_alertNightStart, 0, 24*60-1, DEFAULT_ALERTNIGHTSTART),
+ CONFIG_FIELD("ane", n_alertNightEnd, 0, 24*60-1, DEFAULT_ALERTNIGHTEND),
+ CONFIG_FIELD("tzo", n_timeZone, -12, 14, DEFAULT_TIMEZONE),
+ CONFIG_FIELD("lpn", n_lanPin, 0, 65535, DEFAULT_LANPIN)
+};
+
+const uint8_t c_config::n_fields = sizeof(a_fields) / sizeof(a_fields[0]);
+
+// fixed-offset layouts of firmware 1.4 to 1.6, record started with version
+// major and minor and was kept only for the first door
+typedef struct {
+    uint8_t n_versionMajor;
+    uint8_t n_versionMinor;
+    uint16_t n_readTime;
+    uint16_t n_motionTime;
+    uint16_t n_relayTime;
+    uint16_t n_relayPause;
+    uint8_t n_sensorReads;
+    uint8_t n_sensorThreshold;
+    uint16_t n_alertOpenTimeout;
+    uint16_t n_alertNightStart;
+    uint16_t n_alertNightEnd;
+    float n_timeZone;
+} legacyConfig14;
+
+typedef struct {
+    uint8_t n_versionMajor;
+    uint8_t n_versionMinor;
+    uint16_t n_readTime;
+    uint16_t n_motionTime;
+    uint16_t n_relayTime;
+    uint16_t n_relayPause;
+    uint8_t n_sensorReads;
+    uint8_t n_sensorThreshold;
+    uint8_t n_sensorSequential;
+    uint16_t n_alertOpenTimeout;
+    uint16_t n_alertNightStart;
+    uint16_t n_alertNightEnd;
+    float n_timeZone;
+} legacyConfig15;
+
+typedef struct {
+    uint8_t n_versionMajor;
+    uint8_t n_versionMinor;
+    uint16_t n_readTime;
+    uint16_t n_motionTime;
+    uint16_t n_relayTime;
+    uint16_t n_relayPause;
+    uint8_t n_sensorReads;
+    uint8_t n_sensorThreshold;
+    uint8_t n_sensorSequential;
+    uint16_t n_signalTime;
+    uint16_t n_alertOpenTimeout;
+    uint16_t n_alertNightStart;
+    uint16_t n_alertNightEnd;
+    float n_timeZone;
+} legacyConfig16;
+
+// field of legacy layout of version 1.minor, the type is taken from the member
+#define LEGACY_FIELD(minor, key, member) { \
+   minor, \
+   CONFIG_KEY(key[0], key[1], key[2]), \
+   offsetof(legacyConfig1##minor, member), \
+   c_config::fieldTypeOf<decltype(legacyConfig1##minor::member)>::value \
+}
+
+const c_config::legacyField c_config::a_legacyFields[] = {
+ LEGACY_FIELD(4, "rdt", n_readTime),
+ LEGACY_FIELD(4, "mtt", n_motionTime),
+ LEGACY_FIELD(4, "rlt", n_relayTime),
+ LEGACY_FIELD(4, "rlp", n_relayPause),
+ LEGACY_FIELD(4, "srr", n_sensorReads),
+ LEGACY_FIELD(4, "srt", n_sensorThreshold),
+ LEGACY_FIELD(4, "aot", n_alertOpenTimeout),
+ LEGACY_FIELD(4, "ans", n_alertNightStart),
+ LEGACY_FIELD(4, "ane", n_alertNightEnd),
+ LEGACY_FIELD(4, "tzo", n_timeZone),
+ LEGACY_FIELD(5, "rdt", n_readTime),
+ LEGACY_FIELD(5, "mtt", n_motionTime),
+ LEGACY_FIELD(5, "rlt", n_relayTime),
+ LEGACY_FIELD(5, "rlp", n_relayPause),
+ LEGACY_FIELD(5, "srr", n_sensorReads),
+ LEGACY_FIELD(5, "srt", n_sensorThreshold),
+ LEGACY_FIELD(5, "srs", n_sensorSequential),
+ LEGACY_FIELD(5, "aot", n_alertOpenTimeout),
+ LEGACY_FIELD(5, "ans", n_alertNightStart),
+ LEGACY_FIELD(5, "ane", n_alertNightEnd),
+ LEGACY_FIELD(5, "tzo", n_timeZone),
+ LEGACY_FIELD(6, "rdt", n_readTime),
+ LEGACY_FIELD(6, "mtt", n_motionTime),
+ LEGACY_FIELD(6, "rlt", n_relayTime),
+ LEGACY_FIELD(6, "rlp", n_relayPause),
+ LEGACY_FIELD(6, "srr", n_sensorReads),
+ LEGACY_FIELD(6, "srt", n_sensorThreshold),
+ LEGACY_FIELD(6, "srs", n_sensorSequential),
+ LEGACY_FIELD(6, "sgt", n_signalTime),
+ LEGACY_FIELD(6, "aot", n_alertOpenTimeout),
+ LEGACY_FIELD(6, "ans", n_alertNightStart),
+ LEGACY_FIELD(6, "ane", n_alertNightEnd),
+ LEGACY_FIELD(6, "tzo", n_timeZone)
+};
+
+static_assert(
+ sizeof(legacyConfig16) <= JOURNAL_SLOTSIZE,
+ "legacy record must stay within the first journal slot"
+);
+
 /** constructor */
-c_config::c_config() {
+c_config::c_config(uint8_t n_door) {
+   n_index = n_door;
    f_load();
-   Particle.variable("doorConfig", s_config, STRING);
 }
 
 /**
-* Loads saved configuration from EEPROM or defaults
+* Loads newest valid configuration record from EEPROM or defaults
+* Records from other firmware versions are migrated field by field, fields
+* unknown to the record get default values. Without any journal record the
+* fixed-offset record of firmware 1.4 to 1.6 is imported.
 */
 bool c_config::f_load() {
 
-   // read door config from EEPROM
-   for (uint8_t n_byte = 0; n_byte < sizeof(configStruct); n_byte++)
-       a_config.bytes[n_byte] = EEPROM.read(n_byte);
+   uint8_t a_record[JOURNAL_SLOTSIZE];
+   uint16_t n_slots = f_journalSlots();
+   b_journalValid = FALSE;
+
+   // scan headers for the newest sequence number and verify CRC of that
+   // record only, fall back to older records if it is damaged
+   uint32_t n_rejected = 0;
+   do {
+       b_journalValid = FALSE;
+       for (uint16_t n_slot = 0; n_slot < n_slots; n_slot++) {
+           uint16_t n_base = f_slotBase(n_slot);
+           if (n_rejected & (1UL << n_slot) || EEPROM.read(n_base) != JOURNAL_MAGIC)
+               continue;
+           uint16_t n_seq = EEPROM.read(n_base + 1) | EEPROM.read(n_base + 2) << 8;
+           if (b_journalValid && (int16_t)(n_seq - n_journalSeq) <= 0)
+               continue;
+           n_journalSlot = n_slot;
+           n_journalSeq = n_seq;
+           b_journalValid = TRUE;
+       }
+       if (b_journalValid && f_readRecord(n_journalSlot, a_record))
+           break;
+       n_rejected |= 1UL << n_journalSlot;
+   }
+   while (b_journalValid);
 
-   // if integrity check failed then load defaults
-   if (a_config.values.n_versionMajor != VERSION_MAJOR ||
-       a_config.values.n_versionMinor != VERSION_MINOR) {
+   // nothing saved yet or all records damaged, devices upgraded from the
+   // fixed-offset layout keep their settings
+   if (!b_journalValid) {
+       if (f_importLegacy())
+           return TRUE;
        f_reset();
        return FALSE;
    }
-   f_update();
+
+   f_setDefaults();
+   uint8_t n_loaded = f_deserialize(a_record + JOURNAL_HEADERSIZE, a_record[5]);
+
+   // limits may differ from those the record was saved with, validated
+   // first so records of other versions are checked too
+   bool b_fixed = f_validate();
+   // re-save in current format if record came from another version
+   if (a_record[3] != VERSION_MAJOR || a_record[4] != VERSION_MINOR ||
+       n_loaded != n_fields || b_fixed)
+       f_save();
    return TRUE;
 }
 
 /**
-* Saves updated configuration variables to EEPROM
+* Imports record of firmware before the journal once, the first journal
+* record goes to the second slot so the legacy record survives until the
+* journal record is complete
+* @return TRUE if legacy record was found and imported
 */
-int8_t c_config::f_save() {
-   uint8_t n_updates = 0;
-   for (uint8_t n_byte = 0; n_byte < sizeof(configStruct); n_byte++) {
-       if (a_config.bytes[n_byte] != EEPROM.read(n_byte)) {
-           EEPROM.write(n_byte, a_config.bytes[n_byte]);
-           n_updates++;
-       }
+bool c_config::f_importLegacy() {
+ uint8_t n_major = EEPROM.read(0);
+ uint8_t n_minor = EEPROM.read(1);
+ if (n_index || n_major != 0x01)
+   return FALSE;
+
+ uint8_t a_legacy[sizeof(legacyConfig16)];
+ for (uint8_t n_byte = 0; n_byte < sizeof(a_legacy); n_byte++)
+   a_legacy[n_byte] = EEPROM.read(n_byte);
+
+ f_setDefaults();
+ uint8_t n_imported = 0;
+ for (uint8_t n_field = 0; n_field < sizeof(a_legacyFields) / sizeof(a_legacyFields[0]); n_field++) {
+   const legacyField* a_legacyField = &a_legacyFields[n_field];
+   const configField* a_field = f_findField(a_legacyField->n_key);
+   if (a_legacyField->n_version != n_minor || !a_field)
+     continue;
+   const uint8_t* p_value = a_legacy + a_legacyField->n_offset;
+   switch (a_legacyField->n_type) {
+     case FIELD_U8:
+       f_setField(a_field, *p_value);
+       break;
+     case FIELD_U16: {
+       uint16_t n_value;
+       memcpy(&n_value, p_value, sizeof(n_value));
+       f_setField(a_field, n_value);
+       break;
+     }
+     default: {
+       float n_value;
+       memcpy(&n_value, p_value, sizeof(n_value));
+       f_setField(a_field, n_value);
+     }
    }
-   f_update();
-   return n_updates;
+   n_imported++;
+ }
+ // version not known to have the fixed-offset layout
+ if (!n_imported)
+   return FALSE;
+ f_validate();
+
+ #ifdef APPDEBUG
+   Serial.print("Imported configuration of version 1.");
+   Serial.println(n_minor);
+ #endif
+ n_journalSlot = 1;
+ f_save();
+ return TRUE;
 }
 
+/**
+* Appends configuration record to the next EEPROM slot if values changed
+* Header is written last so interrupted write leaves previous record newest.
+* @return Number of changed payload bytes
+*/
+int8_t c_config::f_save() {
+
+   uint8_t a_record[JOURNAL_SLOTSIZE];
+   uint8_t n_length = f_serialize(a_record + JOURNAL_HEADERSIZE);
+   uint8_t n_updates = n_length;
+
+   a_record[0] = JOURNAL_MAGIC;
+   a_record[3] = VERSION_MAJOR;
+   a_record[4] = VERSION_MINOR;
+   a_record[5] = n_length;
+
+   // compare with the newest record, nothing to write if unchanged
+   if (b_journalValid) {
+       uint16_t n_base = f_slotBase(n_journalSlot);
+       n_updates = 0;
+       for (uint8_t n_byte = 3; n_byte < JOURNAL_HEADERSIZE + n_length; n_byte++)
+           if (a_record[n_byte] != EEPROM.read(n_base + n_byte))
+               n_updates++;
+       if (!n_updates)
+           return 0;
+       n_journalSlot = (n_journalSlot + 1) % f_journalSlots();
+       n_journalSeq++;
+   }
+
+   a_record[1] = n_journalSeq;
+   a_record[2] = n_journalSeq >> 8;
+   uint16_t n_crc = f_crc16(a_record, JOURNAL_HEADERSIZE + n_length);
+   a_record[JOURNAL_HEADERSIZE + n_length] = n_crc;
+   a_record[JOURNAL_HEADERSIZE + n_length + 1] = n_crc >> 8;
+
+   uint16_t n_base = f_slotBase(n_journalSlot);
+   for (uint8_t n_byte = JOURNAL_HEADERSIZE + n_length + 2; n_byte > 0; n_byte--)
+       if (a_record[n_byte - 1] != EEPROM.read(n_base + n_byte - 1))
+           EEPROM.write(n_base + n_byte - 1, a_record[n_byte - 1]);
+   b_journalValid = TRUE;
+   return n_updates > 127 ? 127 : n_updates;
+}
 
 /**
 * Loads configuration with default values
 */
 int8_t c_config::f_reset() {
+ f_setDefaults();
+ return f_save();
+}
+
+/**
+* Sets all values to defaults without saving
+*/
+void c_config::f_setDefaults() {
+ for (uint8_t n_field = 0; n_field < n_fields; n_field++)
+   f_setField(&a_fields[n_field], a_fields[n_field].n_default);
  a_config.values.n_versionMajor = VERSION_MAJOR;
  a_config.values.n_versionMinor = VERSION_MINOR;
- a_config.values.n_readTime = DEFAULT_READTIME;
- a_config.values.n_motionTime = DEFAULT_MOTIONTIME;
- a_config.values.n_relayTime = DEFAULT_RELAYTIME;
- a_config.values.n_relayPause = DEFAULT_RELAYPAUSE;
- a_config.values.n_sensorReads = DEFAULT_SENSORREADS;
- a_config.values.n_sensorThreshold = DEFAULT_SENSORTRESHOLD;
- a_config.values.n_alertOpenTimeout = DEFAULT_ALERTOPENTIMEOUT;
- a_config.values.n_alertNightStart = DEFAULT_ALERTNIGHTSTART;
- a_config.values.n_alertNightEnd = DEFAULT_ALERTNIGHTEND;
- a_config.values.n_timeZone = DEFAULT_TIMEZONE;
- return f_save();
+}
+
+/**
+* Replaces out of range values with defaults
+* @return TRUE if any of the values was replaced
+*/
+bool c_config::f_validate() {
+ bool b_fixed = FALSE;
+ for (uint8_t n_field = 0; n_field < n_fields; n_field++) {
+   float n_value = f_getField(&a_fields[n_field]);
+   // negated comparison also catches NaN in float fields
+   if (!(n_value >= a_fields[n_field].n_min && n_value <= a_fields[n_field].n_max)) {
+     f_setField(&a_fields[n_field], a_fields[n_field].n_default);
+     b_fixed = TRUE;
+   }
+ }
+ return b_fixed;
 }
 
 /**
 * Generates the string for door configuration variables
 */
-void c_config::f_update() {
- sprintf(
-   s_config,
-   "ver=%u.%u|rdt=%u|mtt=%u|rlt=%u|rlp=%u|srr=%u|srt=%u|aot=%u|ans=%u|ane=%u|tzo=%.1f",
+void c_config::f_render(char* s_buffer) {
+ static_assert(
+   sizeof(a_fields) / sizeof(a_fields[0]) * 11 + 12 <= CONFIG_TEXTSIZE,
+   "rendered configuration does not fit CONFIG_TEXTSIZE"
+ );
+ int n_length = sprintf(
+   s_buffer,
+   "ver=%u.%u",
    a_config.values.n_versionMajor,
-   a_config.values.n_versionMinor,
-   a_config.values.n_readTime,
-   a_config.values.n_motionTime,
-   a_config.values.n_relayTime,
-   a_config.values.n_relayPause,
-   a_config.values.n_sensorReads,
-   a_config.values.n_sensorThreshold,
-   a_config.values.n_alertOpenTimeout,
-   a_config.values.n_alertNightStart,
-   a_config.values.n_alertNightEnd,
-   a_config.values.n_timeZone
+   a_config.values.n_versionMinor
  );
+ for (uint8_t n_field = 0; n_field < n_fields; n_field++) {
+   const configField* a_field = &a_fields[n_field];
+   n_length += sprintf(
+     s_buffer + n_length,
+     a_field->n_type == FIELD_FLOAT ? "|%c%c%c=%.1f" : "|%c%c%c=%.0f",
+     (char)(a_field->n_key >> 16),
+     (char)(a_field->n_key >> 8),
+     (char)a_field->n_key,
+     f_getField(a_field)
+   );
+ }
 }
 
 /**
 * Parses received configuration string and updates the values
+* Keys and values are read in place, no intermediate strings are created.
+* Keys are packed into integers and looked up in the schema.
 */
-int8_t c_config::f_set(String s_newConfig) {
+int8_t c_config::f_set(const char* s_newConfig) {
 
- int n_start = 0, n_end, n_value;
- String s_command, s_value;
+ const char* s_command = s_newConfig;
+ const char* s_value;
+ const char* s_end;
+ const configField* a_field;
+ float n_value;
 
  #ifdef APPDEBUG
    Serial.print("Received Door Config: ");
@@ -105,75 +374,179 @@ int8_t c_config::f_set(String s_newConfig) {
  #endif
 
  do {
-   n_end = s_newConfig.indexOf('=', n_start);
-   if (n_end == -1)
+   s_value = strchr(s_command, '=');
+   if (!s_value)
      return -1;
-   s_command = s_newConfig.substring(n_start, n_end).c_str();
-   n_start = n_end + 1;
+   s_value++;
+   s_end = strchr(s_value, '|');
 
-   n_end = s_newConfig.indexOf('|', n_start);
-   if (n_end == -1) {
-     s_value = s_newConfig.substring(n_start).c_str();
-   }
-   else {
-     s_value = s_newConfig.substring(n_start, n_end).c_str();
-     n_start = n_end + 1;
+   a_field = f_findField(f_keyCode(s_command, s_value - s_command - 1));
+   if (a_field) {
+     // numeric parsing stops at the '|' delimiter
+     n_value = strtod(s_value, NULL);
+     if (!(n_value >= a_field->n_min && n_value <= a_field->n_max))
+       n_value = a_field->n_default;
+     f_setField(a_field, n_value);
    }
 
-   if (s_command.equals("rdt")) {
-     n_value = s_value.toInt();
-     if (n_value < 200 || n_value > 60000)
-       n_value = DEFAULT_READTIME;
-     a_config.values.n_readTime = n_value;
-   }
-   else if (s_command.equals("mtt")) {
-     n_value = s_value.toInt();
-     if (n_value < 500 || n_value > 10000)
-       n_value = DEFAULT_MOTIONTIME;
-     a_config.values.n_motionTime = n_value;
-   }
-   else if (s_command.equals("rlt")) {
-     n_value = s_value.toInt();
-     if (n_value < 10 || n_value > 2000)
-       n_value = DEFAULT_RELAYTIME;
-     a_config.values.n_relayTime = n_value;
-   }
-   else if (s_command.equals("rlp")) {
-     n_value = s_value.toInt();
-     if (n_value < 10 || n_value > 5000)
-       n_value = DEFAULT_RELAYPAUSE;
-     a_config.values.n_relayPause = n_value;
-   }
-   else if (s_command.equals("srr")) {
-     n_value = s_value.toInt();
-     if (n_value < 1 || n_value > 20)
-       n_value = DEFAULT_SENSORREADS;
-     a_config.values.n_sensorReads = n_value;
-   }
-   else if (s_command.equals("srt")) {
-     n_value = s_value.toInt();
-     if (n_value < 1 || n_value > 80)
-       n_value = DEFAULT_SENSORTRESHOLD;
-     a_config.values.n_sensorThreshold = n_value;
-   }
-   else if (s_command.equals("aot")) {
-     n_value = s_value.toInt();
-     a_config.values.n_alertOpenTimeout = n_value;
-   }
-   else if (s_command.equals("ans")) {
-     n_value = s_value.toInt();
-     a_config.values.n_alertNightStart = n_value;
+   if (s_end)
+     s_command = s_end + 1;
+ }
+ while (s_end);
+
+ Time.zone(a_config.values.n_timeZone);
+ return f_save();
+}
+
+/**
+* Packs three character key into an integer, other lengths never match
+*/
+uint32_t c_config::f_keyCode(const char* s_key, size_t n_length) {
+ if (n_length != 3)
+   return 0;
+ return CONFIG_KEY(s_key[0], s_key[1], s_key[2]);
+}
+
+/**
+* Finds schema entry by packed key
+* @return Field description or NULL if key is unknown
+*/
+const c_config::configField* c_config::f_findField(uint32_t n_key) {
+ for (uint8_t n_field = 0; n_field < n_fields; n_field++)
+   if (a_fields[n_field].n_key == n_key)
+     return &a_fields[n_field];
+ return NULL;
+}
+
+/**
+* Reads field value from configuration structure
+* Values are copied with the size of their type so the access stays within
+* the structure whatever the offset.
+*/
+float c_config::f_getField(const configField* a_field) {
+ const uint8_t* p_value = a_config.bytes + a_field->n_offset;
+ switch (a_field->n_type) {
+   case FIELD_U8:
+     return *p_value;
+   case FIELD_U16: {
+     uint16_t n_value;
+     memcpy(&n_value, p_value, sizeof(n_value));
+     return n_value;
    }
-   else if (s_command.equals("ane")) {
-     n_value = s_value.toInt();
-     a_config.values.n_alertNightEnd = n_value;
+   default: {
+     float n_value;
+     memcpy(&n_value, p_value, sizeof(n_value));
+     return n_value;
    }
-   else if (s_command.equals("tzo")) {
-     float n_valueFloat = s_value.toFloat();
-     a_config.values.n_timeZone = n_valueFloat;
-     Time.zone(n_valueFloat);
+ }
+}
+
+/**
+* Writes field value to configuration structure
+*/
+void c_config::f_setField(const configField* a_field, float n_value) {
+ uint8_t* p_value = a_config.bytes + a_field->n_offset;
+ switch (a_field->n_type) {
+   case FIELD_U8:
+     *p_value = n_value;
+     break;
+   case FIELD_U16: {
+     uint16_t n_stored = n_value;
+     memcpy(p_value, &n_stored, sizeof(n_stored));
+     break;
    }
+   default:
+     memcpy(p_value, &n_value, sizeof(n_value));
  }
- while (n_end != -1);
- return f_save();
+}
+
+/**
+* Reports number of journal slots of each door, EEPROM is split for
+* DOOR_MAXCOUNT so journals stay in place when DOOR_COUNT changes
+*/
+uint16_t c_config::f_journalSlots() {
+ uint16_t n_slots = EEPROM.length() / DOOR_MAXCOUNT / JOURNAL_SLOTSIZE;
+ return n_slots > JOURNAL_MAXSLOTS ? JOURNAL_MAXSLOTS : n_slots;
+}
+
+/**
+* Reports EEPROM address of the journal slot
+*/
+uint16_t c_config::f_slotBase(uint16_t n_slot) {
+ return (n_index * f_journalSlots() + n_slot) * JOURNAL_SLOTSIZE;
+}
+
+/**
+* Reads journal record and verifies its integrity
+* @param[out] uint8_t* a_record Buffer of JOURNAL_SLOTSIZE bytes
+* @return TRUE if record is valid
+*/
+bool c_config::f_readRecord(uint16_t n_slot, uint8_t* a_record) {
+ uint16_t n_base = f_slotBase(n_slot);
+ for (uint8_t n_byte = 0; n_byte < JOURNAL_HEADERSIZE; n_byte++)
+   a_record[n_byte] = EEPROM.read(n_base + n_byte);
+ if (a_record[0] != JOURNAL_MAGIC || a_record[5] > JOURNAL_SLOTSIZE - JOURNAL_HEADERSIZE - 2)
+   return FALSE;
+
+ uint8_t n_total = JOURNAL_HEADERSIZE + a_record[5] + 2;
+ for (uint8_t n_byte = JOURNAL_HEADERSIZE; n_byte < n_total; n_byte++)
+   a_record[n_byte] = EEPROM.read(n_base + n_byte);
+ uint16_t n_crc = a_record[n_total - 2] | a_record[n_total - 1] << 8;
+ return n_crc == f_crc16(a_record, n_total - 2);
+}
+
+/**
+* Packs configuration values as key/value entries
+* @return Payload length
+*/
+uint8_t c_config::f_serialize(uint8_t* a_payload) {
+ static_assert(
+   sizeof(a_fields) / sizeof(a_fields[0]) * JOURNAL_ENTRYSIZE + JOURNAL_HEADERSIZE + 2 <= JOURNAL_SLOTSIZE,
+   "configuration record does not fit in journal slot"
+ );
+ uint8_t n_length = 0;
+ for (uint8_t n_field = 0; n_field < n_fields; n_field++) {
+   float n_value = f_getField(&a_fields[n_field]);
+   a_payload[n_length++] = a_fields[n_field].n_key >> 16;
+   a_payload[n_length++] = a_fields[n_field].n_key >> 8;
+   a_payload[n_length++] = a_fields[n_field].n_key;
+   memcpy(a_payload + n_length, &n_value, sizeof(float));
+   n_length += sizeof(float);
+ }
+ return n_length;
+}
+
+/**
+* Loads values from key/value entries, unknown keys and values out of
+* range are skipped so the field keeps its default
+* @return Number of fields loaded
+*/
+uint8_t c_config::f_deserialize(const uint8_t* a_payload, uint8_t n_length) {
+ uint8_t n_loaded = 0;
+ for (uint8_t n_pos = 0; n_pos + JOURNAL_ENTRYSIZE <= n_length; n_pos += JOURNAL_ENTRYSIZE) {
+   const configField* a_field = f_findField(CONFIG_KEY(a_payload[n_pos], a_payload[n_pos + 1], a_payload[n_pos + 2]));
+   if (!a_field)
+     continue;
+   float n_value;
+   memcpy(&n_value, a_payload + n_pos + 3, sizeof(float));
+   // checked before narrowing to the field type, negated to catch NaN
+   if (!(n_value >= a_field->n_min && n_value <= a_field->n_max))
+     continue;
+   f_setField(a_field, n_value);
+   n_loaded++;
+ }
+ return n_loaded;
+}
+
+/**
+* CRC-16/CCITT-FALSE checksum
+*/
+uint16_t c_config::f_crc16(const uint8_t* a_data, uint16_t n_length) {
+ uint16_t n_crc = 0xFFFF;
+ while (n_length--) {
+   n_crc ^= (uint16_t)*a_data++ << 8;
+   for (uint8_t n_bit = 0; n_bit < 8; n_bit++)
+     n_crc = n_crc & 0x8000 ? (n_crc << 1) ^ 0x1021 : n_crc << 1;
+ }
+ return n_crc;
 }
@@ -3,32 +3,67 @@
  * @file config.h
  * @brief Implements garadget configuration related functionality
  * @author Denis Grisak
- * @version 1.3
+ * @version 1.4
  */
 // $Log$
 
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h>
 #include "application.h"
 #include "global.h"
 
+// packs three character configuration key into an integer
+#define CONFIG_KEY(a, b, c) (((uint32_t)(uint8_t)(a) << 16) | ((uint32_t)(uint8_t)(b) << 8) | (uint8_t)(c))
+
+// longest rendered configuration, "|key=value" of up to 11 bytes per field
+#define CONFIG_TEXTSIZE 192
+
+// describes one configuration field, see c_config::a_fields
+#define CONFIG_FIELD(key, member, minValue, maxValue, defaultValue) { \
+    CONFIG_KEY(key[0], key[1], key[2]), \
+    offsetof(configStruct, member), \
+    c_config::fieldTypeOf<decltype(configStruct::member)>::value, \
+    minValue, \
+    maxValue, \
+    defaultValue \
+}
+
+// configuration records are appended round-robin across EEPROM in slots
+// of this size, oldest record is overwritten first
+#define JOURNAL_SLOTSIZE 128
+// upper limit for number of slots, tracked in a 32 bit mask while loading
+#define JOURNAL_MAXSLOTS 32
+// marks the slot as used, empty EEPROM reads 0xFF
+#define JOURNAL_MAGIC 0x5A
+// magic, sequence number (2), version major, minor, payload length
+#define JOURNAL_HEADERSIZE 6
+// each payload entry is a packed key (3) followed by float value (4)
+#define JOURNAL_ENTRYSIZE 7
+
 class c_config {
 
-      // this structure must fit in EEPROM so total size must be under 100 bytes
+      // this structure is kept in RAM only, EEPROM holds journal records
+      // keyed by field so layout can change between versions
     typedef struct {
         uint8_t n_versionMajor;
         uint8_t n_versionMinor;
         uint16_t n_readTime;
+        uint16_t n_readFast;
         uint16_t n_motionTime;
         uint16_t n_relayTime;
         uint16_t n_relayPause;
         uint8_t n_sensorReads;
         uint8_t n_sensorThreshold;
+        uint8_t n_sensorSequential;
+        uint16_t n_signalTime;
         uint16_t n_alertOpenTimeout;
+        uint16_t n_alertOpenReminder;
         uint16_t n_alertNightStart;
         uint16_t n_alertNightEnd;
         float n_timeZone;
+        uint16_t n_lanPin;
     } configStruct;
 
     union doorConfig {
@@ -36,23 +71,87 @@ class c_config {
         uint8_t bytes[sizeof(configStruct)];
     };
 
+    enum fieldType {
+        FIELD_U8,
+        FIELD_U16,
+        FIELD_FLOAT
+    };
+
+    // maps storage type of configuration field to fieldType
+    template <typename T> struct fieldTypeOf;
+
+    typedef struct {
+        uint32_t n_key;
+        uint8_t n_offset;
+        uint8_t n_type;
+        float n_min;
+        float n_max;
+        float n_default;
+    } configField;
+
+    // schema of configuration fields, drives parsing, validation,
+    // rendering and defaults
+    static const configField a_fields[];
+    static const uint8_t n_fields;
+
+    // field positions of fixed-offset records saved at EEPROM address 0
+    // by firmware before the journal, tagged with the minor version
+    typedef struct {
+        uint8_t n_version;
+        uint32_t n_key;
+        uint8_t n_offset;
+        uint8_t n_type;
+    } legacyField;
+    static const legacyField a_legacyFields[];
+
+    // journal of each door occupies own part of EEPROM
+    uint8_t n_index;
+    // position of the newest valid journal record
+    uint16_t n_journalSlot = 0;
+    uint16_t n_journalSeq = 0;
+    bool b_journalValid = FALSE;
+
 public:
-    char s_config[MAXVARSIZE];
     doorConfig a_config;
 
-    c_config();
+/**
+ * Configuration constructor, loads saved configuration
+ * @param[in] uint8_t n_door Index of the door the configuration belongs to
+ */
+    c_config(uint8_t n_door = 0);
 /**
  * Parses the provided string and saves values to device's config'
  * @param[in] s_config String to parse and save
  * @return 0 on success and -1 on failure
  */
-    int8_t f_set(String s_config);
+    int8_t f_set(const char* s_config);
+/**
+ * Renders configuration variable string
+ * @param[out] char* s_buffer Output buffer of CONFIG_TEXTSIZE
+ */
+    void f_render(char* s_buffer);
 
 protected:
     bool f_load();
+    bool f_importLegacy();
     int8_t f_save();
     int8_t f_reset();
-    void f_update();
+    void f_setDefaults();
+    bool f_validate();
+    uint32_t f_keyCode(const char* s_key, size_t n_length);
+    const configField* f_findField(uint32_t n_key);
+    float f_getField(const configField* a_field);
+    void f_setField(const configField* a_field, float n_value);
+    uint16_t f_journalSlots();
+    uint16_t f_slotBase(uint16_t n_slot);
+    bool f_readRecord(uint16_t n_slot, uint8_t* a_record);
+    uint8_t f_serialize(uint8_t* a_payload);
+    uint8_t f_deserialize(const uint8_t* a_payload, uint8_t n_length);
+    static uint16_t f_crc16(const uint8_t* a_data, uint16_t n_length);
 };
 
+template <> struct c_config::fieldTypeOf<uint8_t> { static const uint8_t value = FIELD_U8; };
+template <> struct c_config::fieldTypeOf<uint16_t> { static const uint8_t value = FIELD_U16; };
+template <> struct c_config::fieldTypeOf<float> { static const uint8_t value = FIELD_FLOAT; };
+
 #endif
@@ -8,38 +8,137 @@
 // $Log$
 
 #include "door.h"
+#include "trace.h"
 
-/** constructor */
-c_door::c_door() {
+static_assert(DOOR_COUNT <= DOOR_MAXCOUNT, "DOOR_COUNT exceeds DOOR_MAXCOUNT");
+// scan, motion, alert, script and relay timeouts of each door plus publisher retry
+static_assert(SCHEDULER_MAXEVENTS >= DOOR_MAXCOUNT * 5 + 1, "SCHEDULER_MAXEVENTS too small for timers of all doors");
+
+char c_door::s_render[MAXVARSIZE];
+#if APPPROFILE
+char c_door::s_profile[MAXVARSIZE];
+#endif
+c_door* c_door::a_instances[DOOR_MAXCOUNT];
+const char* (* const c_door::a_statusVars[DOOR_MAXCOUNT])() = {
+    f_statusVar<0>,
+    f_statusVar<1>,
+    f_statusVar<2>
+};
+const char* (* const c_door::a_configVars[DOOR_MAXCOUNT])() = {
+    f_configVar<0>,
+    f_configVar<1>,
+    f_configVar<2>
+};
+const char* (* const c_door::a_historyVars[DOOR_MAXCOUNT])() = {
+    f_historyVar<0>,
+    f_historyVar<1>,
+    f_historyVar<2>
+};
+#if APPTHREAD
+const char* (* const c_door::a_packedVars[DOOR_MAXCOUNT])() = {
+    f_packedVar<0>,
+    f_packedVar<1>,
+    f_packedVar<2>
+};
+const char* (* const c_door::a_deltaVars[DOOR_MAXCOUNT])() = {
+    f_deltaVar<0>,
+    f_deltaVar<1>,
+    f_deltaVar<2>
+};
+#endif
 
-    // setup hardware
-    pinMode(PIN_RELAY, OUTPUT);
-    digitalWrite(PIN_RELAY, LOW);
+/** constructor */
+c_door::c_door(uint8_t n_door, const doorPins& a_pins, c_scheduler *o_doorScheduler, c_publisher *o_doorPublisher) :
+    n_index(n_door),
+    o_scheduler(o_doorScheduler),
+    o_publisher(o_doorPublisher),
+    o_config(APPNEW(c_config)(n_door)),
+    o_sensor(APPNEW(c_sensor)(a_pins.n_laser, a_pins.n_photo)),
+    o_relay(APPNEW(c_relay)(
+        a_pins.n_relay,
+        o_doorScheduler,
+        &o_config->a_config.values.n_relayTime,
+        &o_config->a_config.values.n_relayPause
+    )),
+    o_telemetry(APPNEW(c_telemetry)()) {
 
     // configure sensor
     o_sensor->f_setParams(
       o_config->a_config.values.n_sensorReads,
-      o_config->a_config.values.n_sensorThreshold
+      o_config->a_config.values.n_sensorThreshold,
+      o_config->a_config.values.n_sensorSequential
     );
 
+    // replay starts from the same configuration
+    #if APPTRACE
+        o_config->f_render(s_render);
+        TRACE_CONFIG(n_index, s_render);
+    #endif
+
     // configure timers
     n_lastEvent = Time.now();
     Time.zone(o_config->a_config.values.n_timeZone);
-    o_scanTimeout->f_setDuration(&o_config->a_config.values.n_readTime);
-    o_motionTimeout->f_setDuration(&o_config->a_config.values.n_motionTime);
-    o_relayOnTimeout->f_setDuration(&o_config->a_config.values.n_relayTime);
-    o_relayOffTimeout->f_setDuration(&o_config->a_config.values.n_relayPause);
+
+    // alert rules read their parameters from configuration
+    o_alerts->f_addRule(ALERT_OPENFOR, "timeout", &o_config->a_config.values.n_alertOpenTimeout);
+    o_alerts->f_addRule(
+        ALERT_REMINDER, "timeout",
+        &o_config->a_config.values.n_alertOpenReminder,
+        &o_config->a_config.values.n_alertOpenTimeout
+    );
+    o_alerts->f_addRule(
+        ALERT_WINDOW, "night",
+        &o_config->a_config.values.n_alertNightStart,
+        &o_config->a_config.values.n_alertNightEnd
+    );
+
+    // first scan is taken right away, then rescheduled on completion
+    o_sensor->f_startRead();
 
     // configure variables
+    f_sampleSignal();
     f_prepStatus();
-    f_prepNetConfig();
-    Particle.variable("doorStatus", s_doorStatus, STRING);
-    Particle.variable("netConfig", s_netConfig, STRING);
+    f_prepStats();
+    a_instances[n_index] = this;
+    char s_name[13];
+    DOOR_NAME(s_name, "doorStatus", n_index);
+    Particle.variable(s_name, a_statusVars[n_index]);
+    DOOR_NAME(s_name, "doorConfig", n_index);
+    Particle.variable(s_name, a_configVars[n_index]);
+    DOOR_NAME(s_name, "telemetry", n_index);
+    Particle.variable(s_name, a_historyVars[n_index]);
+    // read by the cloud thread while being rewritten with APPTHREAD,
+    // diagnostics only so a mix of two updates is tolerated
+    DOOR_NAME(s_name, "doorStats", n_index);
+    Particle.variable(s_name, s_doorStats, STRING);
+    DOOR_NAME(s_name, "doorPacked", n_index);
+    #if APPTHREAD
+        Particle.variable(s_name, a_packedVars[n_index]);
+    #else
+        Particle.variable(s_name, s_doorPacked, STRING);
+    #endif
+    DOOR_NAME(s_name, "statusDelta", n_index);
+    #if APPTHREAD
+        Particle.variable(s_name, a_deltaVars[n_index]);
+    #else
+        Particle.variable(s_name, s_statusDelta, STRING);
+    #endif
+    if (!n_index) {
+        Particle.variable("netConfig", f_netConfigVar);
+        #if APPPROFILE
+            c_profiler::f_init();
+            c_profiler::f_render(s_profile);
+            Particle.variable("profile", s_profile, STRING);
+        #endif
+    }
 
     #ifdef APPDEBUG
         Serial.println("Initialized");
     #endif
-    Particle.publish("state", "init", 60, PRIVATE);
+    f_publish("state", "init");
+    #if APPTHREAD
+        f_syncSnapshot();
+    #endif
 }
 
 /**
@@ -48,105 +147,194 @@ c_door::c_door() {
  */
 void c_door::f_process() {
 
-    Particle.process();
+    // scan starts and motion timeout are handled by scheduler callbacks
+    o_relay->f_process();
+    f_armMotion();
 
-    // handle relay clicks
-    if (o_relayOnTimeout->f_isTimeout())
-        f_relayOff();
-    else if (o_relayOffTimeout->f_isTimeout())
-        f_relayOn();
-
-    // handle regular state scans
-    if (!o_scanTimeout->f_isRunning()) {
+    // handle regular state scans, sensor is read incrementally across passes
+    if (o_sensor->f_processRead()) {
+        doorState n_previousState = n_doorState;
+        o_telemetry->f_append(o_sensor->f_getLastReading(), o_sensor->f_isTripping());
+        f_countScan();
         f_getState();
+        f_motionCheck();
+        // alerts start once the first scan has confirmed the state
+        if (!b_alertsStarted) {
+            b_alertsStarted = true;
+            f_updateAlerts();
+        }
+        f_sampleSignal();
         f_prepStatus();
-        f_prepNetConfig();
-        f_processAlertTimeout();
-        f_processAlertNight();
-        o_scanTimeout->f_start();
+        f_prepStats();
+        f_scheduleScan(n_doorState != n_previousState);
     }
 
-    // hanle motion timeout
-    if (o_motionTimeout->f_isTimeout())
-        f_motionTimeout();
+    // includes changes made by scheduler callbacks earlier in the pass
+    #if APPTHREAD
+        f_syncSnapshot();
+    #endif
 }
 
 /**
- * Handle Open door timeout alert
+ * Schedules the next scan. Door may be moving while relay clicks or motion
+ *  timeout runs and right after a state change, scans are fast then.
+ *  Otherwise scan interval doubles with every scan up to the idle interval.
  */
-void c_door::f_processAlertTimeout() {
-
-  //  skip if door closed, already fired or disabled
-  if (n_doorState == STATE_CLOSED || b_alertFiredTimeout || !o_config->a_config.values.n_alertOpenTimeout)
-    return;
+void c_door::f_scheduleScan(bool b_changed) {
+    uint16_t n_slow = o_config->a_config.values.n_readTime;
+    if (b_changed || o_motionTimeout->f_isRunning() || o_relay->f_isBusy())
+        n_scanInterval = f_getFastInterval();
+    else
+        n_scanInterval = n_scanInterval < n_slow / 2 ? n_scanInterval * 2 : n_slow;
+    if (!n_scanInterval || n_scanInterval > n_slow)
+        n_scanInterval = n_slow;
+    o_scanTimeout->f_setDuration(n_scanInterval);
+    o_scanTimeout->f_start();
+}
 
-  uint32_t n_time = Time.now() - n_lastEvent;
-  if (n_time < o_config->a_config.values.n_alertOpenTimeout)
-    return;
+/**
+ * Brings the pending scan forward to the fast interval, used when motion
+ *  starts between scans
+ */
+void c_door::f_fastScan() {
+    n_scanInterval = f_getFastInterval();
+    if (o_scanTimeout->f_timeLeft() > n_scanInterval) {
+        o_scanTimeout->f_setDuration(n_scanInterval);
+        o_scanTimeout->f_start();
+    }
+}
 
-  char s_time[10];
-  f_formatTime(n_time, s_time);
+/**
+ * Reports fast scan interval, never slower than the idle one
+ */
+uint16_t c_door::f_getFastInterval() {
+    uint16_t n_fast = o_config->a_config.values.n_readFast;
+    uint16_t n_slow = o_config->a_config.values.n_readTime;
+    return n_fast < n_slow ? n_fast : n_slow;
+}
 
-  #ifdef APPDEBUG
-      Serial.print("Timeout alert fired after: ");
-      Serial.println(s_time);
-  #endif
-  Particle.publish("timeout", s_time, 60, PRIVATE);
-  b_alertFiredTimeout = true;
+/**
+ * Counts completed scans, rate is reported for the last full hour or
+ *  extrapolated during the first hour
+ */
+void c_door::f_countScan() {
+    uint32_t n_now = millis();
+    if (!n_hourStart)
+        n_hourStart = n_now;
+    if (n_now - n_hourStart >= 3600000UL) {
+        n_scansPerHour = n_hourScans;
+        n_hourScans = 0;
+        n_hourStart = n_now;
+        b_hourComplete = true;
+    }
+    n_hourScans++;
+    if (!b_hourComplete)
+        n_scansPerHour = n_now - n_hourStart ? (uint64_t)n_hourScans * 3600000UL / (n_now - n_hourStart) : 0;
 }
 
 /**
- * Handle night time open door alert
+ * Idles until the next scheduled event (scan, relay click, motion timeout)
+ *  but no longer than IDLE_MAXTIME so cloud calls are serviced in time.
+ *  Core sleeps between system ticks so every millisecond is re-checked.
+ *  With APPTHREAD the door thread yields to the cloud thread instead.
+ *  Should be called from the main loop after @see f_process()
  */
-void c_door::f_processAlertNight() {
+void c_door::f_idle() {
 
-  //  skip if door closed, already fired or disabled
-  if (n_doorState == STATE_CLOSED || b_alertFiredNight || o_config->a_config.values.n_alertNightStart == o_config->a_config.values.n_alertNightEnd)
-    return;
+    uint32_t n_start = micros();
+    if (n_idleMark)
+        n_awakeTime += n_start - n_idleMark;
 
-  uint16_t n_time = Time.hour() * 60 + Time.minute();
-  uint16_t n_start = o_config->a_config.values.n_alertNightStart;
-  uint16_t n_end = o_config->a_config.values.n_alertNightEnd;
+    // sensor steps are timed in microseconds, keep polling
+    if (!c_sensor::f_isBusy()) {
+        uint32_t n_sleep = o_scheduler->f_timeUntilNext();
+        if (n_sleep > IDLE_MAXTIME)
+            n_sleep = IDLE_MAXTIME;
+        #if APPTHREAD
+            delay(n_sleep);
+        #else
+            uint32_t n_wake = millis() + n_sleep;
+            while ((int32_t)(millis() - n_wake) < 0)
+                __WFI();
+        #endif
+    }
 
-  // period crossing overnight
-  if (n_start > n_end && n_time < n_start && n_time > n_end)
-    return;
-  // period not crossing overnight
-  if (n_start < n_end && (n_time < n_start || n_time > n_end))
-    return;
+    n_idleMark = micros();
+    n_idleTime += n_idleMark - n_start;
+}
 
-  char s_time[6];
-  sprintf(s_time, "%u:%u", Time.hour(), Time.minute());
+/**
+ * Starts sensor reading, called by scan timer
+ */
+void c_door::f_onScanTimeout(void* p_door) {
+    c_door* o_door = (c_door*)p_door;
+    if (!o_door->o_sensor->f_isReading())
+        o_door->o_sensor->f_startRead();
+}
 
-  #ifdef APPDEBUG
-      Serial.print("Night alert fired after: ");
-      Serial.println(s_time);
-  #endif
-  Particle.publish("night", s_time, 60, PRIVATE);
-  b_alertFiredNight = true;
+/**
+ * Handles motion timeout, called by motion timer
+ */
+void c_door::f_onMotionTimeout(void* p_door) {
+    ((c_door*)p_door)->f_motionTimeout();
 }
 
 /**
- * Garage button push (close relay)
- * Initially called with parameter by the command the by timer without parameter
- * @param[in] uint8_t n_clicks - In initial call specifies number of clicks
+ * Handles alert deadline, called by alert timer
  */
-void c_door::f_relayOn(uint8_t n_clicks) {
-    if (n_clicks)
-        n_relayClicksLeft = n_clicks;
-    digitalWrite(PIN_RELAY, HIGH);
-    o_relayOnTimeout->f_start();
+void c_door::f_onAlertTimeout(void* p_door) {
+    ((c_door*)p_door)->f_processAlerts();
 }
 
 /**
- * Garage button release (open relay)
- * Called by timer
+ * Continues script after wait, called by script timer
  */
-void c_door::f_relayOff() {
-    digitalWrite(PIN_RELAY, LOW);
-    n_relayClicksLeft--;
-    if (n_relayClicksLeft)
-        o_relayOffTimeout->f_start();
+void c_door::f_onScriptTimeout(void* p_door) {
+    c_door* o_door = (c_door*)p_door;
+    o_door->b_scriptExpired = true;
+    o_door->f_runScript();
+}
+
+/**
+ * Passes door state to alert rules, called on every state change
+ */
+void c_door::f_updateAlerts() {
+    o_alerts->f_setState(n_doorState != STATE_CLOSED, n_lastEvent);
+    f_processAlerts();
+}
+
+/**
+ * Publishes alerts which are due and arms the timer for the next deadline
+ */
+void c_door::f_processAlerts() {
+  PROFILE(PROFILE_ALERTS);
+
+  uint32_t n_now = Time.now();
+  int8_t n_rule;
+  o_alerts->f_refresh(n_now);
+  while ((n_rule = o_alerts->f_due(n_now)) >= 0) {
+    char s_data[10];
+    if (o_alerts->f_getType(n_rule) == ALERT_WINDOW)
+      sprintf(s_data, "%u:%u", Time.hour(), Time.minute());
+    else
+      f_formatTime(n_now - n_lastEvent, s_data);
+
+    #ifdef APPDEBUG
+        Serial.print("Alert fired: ");
+        Serial.print(o_alerts->f_getEvent(n_rule));
+        Serial.print(" ");
+        Serial.println(s_data);
+    #endif
+    f_publish(o_alerts->f_getEvent(n_rule), s_data);
+  }
+
+  uint32_t n_delay = o_alerts->f_getDelay(n_now);
+  if (n_delay == ALERT_NEVER) {
+    o_alertTimeout->f_stop();
+    return;
+  }
+  o_alertTimeout->f_setDuration(n_delay * 1000);
+  o_alertTimeout->f_start();
 }
 
 /**
@@ -162,54 +350,109 @@ void c_door::f_motionTimeout() {
         case STATE_CLOSING:
             #if APPVIRTUAL
                 n_doorState = STATE_CLOSED;
-                b_alertFiredTimeout = false;
-                b_alertFiredNight = false;
                 f_publishState();
             #else
-                if (f_getState() != STATE_CLOSED) {
-                    n_doorState = STATE_STOPPED;
-                    f_publishState();
-                }
+                // request fresh reading, result is handled by f_motionCheck()
+                b_motionCheck = true;
+                if (!o_sensor->f_isReading())
+                    o_sensor->f_startRead();
             #endif
             break;
     }
 }
 
+/**
+ * Starts motion timeout for learned travel time, opening is not observable
+ *  by the sensor so it is assumed to take as long as closing. Motion starts
+ *  with the last click of the sequence, which may wait behind earlier
+ *  sequences, so with clicks queued the timeout is armed by
+ *  @see f_armMotion() once the relay is done.
+ * @param[in] uint8_t n_clicks Number of clicks queued for the motion
+ */
+void c_door::f_startMotion(uint8_t n_clicks) {
+    b_motionPending = n_clicks;
+    if (b_motionPending)
+        o_motionTimeout->f_stop();
+    else {
+        o_motionTimeout->f_setDuration(o_travel->f_getTimeout(o_config->a_config.values.n_motionTime));
+        o_motionTimeout->f_start();
+    }
+    f_fastScan();
+}
+
+/**
+ * Arms pending motion timeout from the last relay press, time passed since
+ *  the press is taken off
+ */
+void c_door::f_armMotion() {
+    if (!b_motionPending || o_relay->f_isBusy())
+        return;
+    b_motionPending = false;
+    uint32_t n_timeout = o_travel->f_getTimeout(o_config->a_config.values.n_motionTime);
+    uint32_t n_passed = millis() - o_relay->f_getLastPress();
+    o_motionTimeout->f_setDuration(n_timeout > n_passed ? n_timeout - n_passed : 0);
+    o_motionTimeout->f_start();
+}
+
+/**
+ * Completes closing motion timeout once the sensor reading is available
+ */
+void c_door::f_motionCheck() {
+    if (!b_motionCheck)
+        return;
+    b_motionCheck = false;
+    if (n_doorState == STATE_CLOSING) {
+        n_doorState = STATE_STOPPED;
+        f_publishState();
+    }
+}
+
 /**
  * Translates string state to enum
+ * Dispatches on the first character, then confirms the whole word
  */
-c_door::doorState c_door::f_translateState(String s_state) {
-    if (s_state.equals("closed") || s_state.equals("close"))
-        return STATE_CLOSED;
-    if (s_state.equals("open"))
-        return STATE_OPEN;
-    if (s_state.equals("closing"))
-        return STATE_CLOSING;
-    if (s_state.equals("opening"))
-        return STATE_OPENING;
-    if (s_state.equals("stopped"))
-        return STATE_STOPPED;
+c_door::doorState c_door::f_translateState(const char* s_state) {
+    switch (s_state[0]) {
+        case 'c':
+            if (!strcmp(s_state, "closed") || !strcmp(s_state, "close"))
+                return STATE_CLOSED;
+            if (!strcmp(s_state, "closing"))
+                return STATE_CLOSING;
+            break;
+        case 'o':
+            if (!strcmp(s_state, "open"))
+                return STATE_OPEN;
+            if (!strcmp(s_state, "opening"))
+                return STATE_OPENING;
+            break;
+        case 's':
+            if (!strcmp(s_state, "stopped"))
+                return STATE_STOPPED;
+            break;
+    }
     return STATE_UNKNOWN;
 }
 
+/**
+ * Checks state name for script parser
+ */
+bool c_door::f_isState(const char* s_state) {
+    return f_translateState(s_state) != STATE_UNKNOWN;
+}
+
 /**
  * Translates enum state to string
  */
-String c_door::f_translateState(doorState n_state) {
-  switch (n_state) {
-    case STATE_CLOSED:
-      return "closed";
-    case STATE_OPEN:
-      return "open";
-    case STATE_CLOSING:
-      return "closing";
-    case STATE_OPENING:
-      return "opening";
-    case STATE_STOPPED:
-      return "stopped";
-    default:
-      return "unknown";
-  }
+const char* c_door::f_translateState(doorState n_state) {
+  static const char* const a_names[] = {
+    "closed",
+    "open",
+    "closing",
+    "opening",
+    "stopped",
+    "unknown"
+  };
+  return n_state <= STATE_UNKNOWN ? a_names[n_state] : a_names[STATE_UNKNOWN];
 }
 
 /**
@@ -217,6 +460,7 @@ String c_door::f_translateState(doorState n_state) {
  *  handles the logic and updates
  */
 c_door::doorState c_door::f_getState() {
+    PROFILE(PROFILE_STATE);
 
     #if APPVIRTUAL
         return n_doorState == STATE_CLOSED ? STATE_CLOSED : STATE_OPEN;
@@ -225,16 +469,23 @@ c_door::doorState c_door::f_getState() {
 
     // re-set state based on sensor
     if (b_closed && n_doorState != STATE_CLOSED) {
+        // learn close time, slow arrivals after motion timeout count too
+        // so the estimate follows a door getting slower
+        if (b_travelTiming && !o_relay->f_isBusy()) {
+            uint32_t n_travel = millis() - o_relay->f_getLastPress();
+            if (n_travel <= o_config->a_config.values.n_motionTime)
+                o_travel->f_record(n_travel);
+        }
+        b_travelTiming = false;
         n_doorState = STATE_CLOSED;
-        b_alertFiredTimeout = false;
-        b_alertFiredNight = false;
+        b_motionPending = false;
         o_motionTimeout->f_stop();
         f_publishState();
     }
     // opening initiated
     else if (!b_closed && n_doorState == STATE_CLOSED) {
         n_doorState = STATE_OPENING;
-        o_motionTimeout->f_start();
+        f_startMotion(0);
         f_publishState();
     }
     return n_doorState;
@@ -243,7 +494,7 @@ c_door::doorState c_door::f_getState() {
 /**
  * Processes the external state change request
  */
-signed char c_door::f_setState(String s_state) {
+int c_door::f_setState(const char* s_state) {
 
   #ifdef APPDEBUG
     Serial.print("Received State Request: ");
@@ -251,10 +502,75 @@ signed char c_door::f_setState(String s_state) {
   #endif
 
   doorState n_requestedState = f_translateState(s_state);
-  if (n_requestedState == STATE_UNKNOWN)
+  if (n_requestedState != STATE_UNKNOWN) {
+      // plain request overrides running script
+      f_stopScript();
+      f_setState(n_requestedState);
+      return 0;
+  }
+
+  int16_t n_id = o_script->f_load(s_state, f_isState);
+  if (n_id < 0)
       return -1;
-  f_setState(n_requestedState);
-  return 0;
+  o_scriptTimeout->f_stop();
+  b_scriptExpired = false;
+  f_runScript();
+  return n_id;
+}
+
+/**
+ * Executes script steps until one has to wait for time or door state,
+ *  called on start, on every state change and by script timer
+ */
+void c_door::f_runScript() {
+  // state steps re-enter through f_publishState()
+  if (b_scriptRunning)
+      return;
+  b_scriptRunning = true;
+
+  const scriptStep* a_step;
+  char s_data[32];
+  while ((a_step = o_script->f_current())) {
+    if (a_step->n_op == SCRIPT_STATE)
+        f_setState(f_translateState(a_step->s_arg));
+    else if (a_step->n_op == SCRIPT_PUBLISH) {
+        sprintf(s_data, "id=%u|status=%s", o_script->f_getId(), f_translateState(n_doorState));
+        f_publish(a_step->s_arg, s_data);
+    }
+    else if (a_step->n_op == SCRIPT_AWAIT && n_doorState == f_translateState(a_step->s_arg)) {
+        o_scriptTimeout->f_stop();
+        b_scriptExpired = false;
+    }
+    else if (b_scriptExpired) {
+        b_scriptExpired = false;
+        // door did not reach awaited state in time
+        if (a_step->n_op == SCRIPT_AWAIT) {
+            sprintf(s_data, "id=%u|step=%u|error=timeout", o_script->f_getId(), o_script->f_getStep() + 1);
+            f_publish(SCRIPT_EVENT, s_data);
+            o_script->f_stop();
+            break;
+        }
+    }
+    else {
+        if (!o_scriptTimeout->f_isRunning()) {
+            o_scriptTimeout->f_setDuration(a_step->n_time);
+            o_scriptTimeout->f_start();
+        }
+        break;
+    }
+    o_script->f_next();
+  }
+
+  b_scriptRunning = false;
+}
+
+/**
+ * Abandons running script
+ */
+void c_door::f_stopScript() {
+  o_script->f_stop();
+  o_scriptTimeout->f_stop();
+  b_scriptExpired = false;
 }
 
 /**
@@ -288,7 +604,8 @@ c_door::doorState c_door::f_setState(doorState n_requestedState) {
             n_clicks = 2;
           break;
         }
-        o_motionTimeout->f_start();
+        b_travelTiming = false;
+        f_startMotion(n_clicks);
         break;
 
     // close command
@@ -306,7 +623,8 @@ c_door::doorState c_door::f_setState(doorState n_requestedState) {
           n_clicks = 2;
           break;
       }
-      o_motionTimeout->f_start();
+      b_travelTiming = true;
+      f_startMotion(n_clicks);
       n_newDoorState = STATE_CLOSING;
       break;
 
@@ -324,6 +642,8 @@ c_door::doorState c_door::f_setState(doorState n_requestedState) {
           n_clicks = 2;
           break;
       }
+      b_travelTiming = false;
+      b_motionPending = false;
       o_motionTimeout->f_stop();
       n_newDoorState = STATE_STOPPED;
       break;
@@ -333,7 +653,7 @@ c_door::doorState c_door::f_setState(doorState n_requestedState) {
       return n_doorState;
   }
 
-  f_relayOn(n_clicks);
+  o_relay->f_command(n_clicks);
   n_doorState = n_newDoorState;
   f_publishState();
 
@@ -352,18 +672,36 @@ void c_door::f_publishState() {
         Serial.print("Publishing New State: ");
         Serial.println(f_translateState(n_doorState));
     #endif
-    Particle.publish("state", f_translateState(n_doorState), 60, PRIVATE);
+    f_publish("state", f_translateState(n_doorState), TRUE);
     n_lastEvent = Time.now();
+    b_statusDirty = true;
+    #if APPTHREAD
+        b_snapshotDirty = true;
+    #endif
     f_prepStatus();
+    f_updateAlerts();
+    if (o_script->f_isRunning())
+        f_runScript();
+}
+
+/**
+ * Publishes event named for this door
+ */
+void c_door::f_publish(const char* s_event, const char* s_data, bool b_coalesce) {
+    char s_name[PUBLISH_NAMESIZE];
+    DOOR_NAME(s_name, s_event, n_index);
+    o_publisher->f_publish(s_name, s_data, b_coalesce);
 }
 
 /**
- * Generates the string for network configuration variable
+ * Renders network configuration variable on request, device wide so
+ *  registered by the first door only
  */
-bool c_door::f_prepNetConfig() {
+const char* c_door::f_netConfigVar() {
+  PROFILE(PROFILE_NETCONFIG);
 
   if (!WiFi.ready())
-    return FALSE;
+    return "";
 
   IPAddress a_localIp = WiFi.localIP();
   IPAddress a_netMask = WiFi.subnetMask();
@@ -373,7 +711,7 @@ bool c_door::f_prepNetConfig() {
   WiFi.macAddress(n_macAddress);
 
   sprintf(
-    s_netConfig,
+    s_render,
     "ip=%d.%d.%d.%d|snet=%d.%d.%d.%d|gway=%d.%d.%d.%d|mac=%02X:%02X:%02X:%02X:%02X:%02X|ssid=%s",
     a_localIp[0], // 4+15 bytes
     a_localIp[1],
@@ -395,28 +733,326 @@ bool c_door::f_prepNetConfig() {
     n_macAddress[5],
     WiFi.SSID() // 6+32 bytes
   );
-  return TRUE;
+  return s_render;
 }
 
 /**
- * Generates the string for door state variables
+ * Captures displayed door state values, packed records are regenerated
+ *  only when one of them changes
  */
 void c_door::f_prepStatus() {
+    PROFILE(PROFILE_STATUS);
 
-    char s_time[10];
-    uint32_t n_time = Time.now() - n_lastEvent;
-    f_formatTime(n_time, s_time);
+    uint8_t n_reading = o_sensor->f_getLastReading();
+
+    // skip if nothing displayed has changed
+    if (!b_statusDirty && n_reading == n_statusReading && n_signal == n_statusSignal) {
+        n_statusSkipped++;
+        return;
+    }
 
+    n_statusReading = n_reading;
+    n_statusSignal = n_signal;
+    b_statusDirty = false;
+    f_prepPacked();
+}
+
+/**
+ * Renders door state variable on request
+ */
+const char* c_door::f_getStatus(char* s_buffer) {
+  #if APPTHREAD
+    doorSnapshot a_snapshot;
+    o_snapshot->f_read(a_snapshot);
+    doorState n_state = (doorState)a_snapshot.n_state;
+    uint32_t n_since = a_snapshot.n_lastEvent;
+    uint8_t n_reading = a_snapshot.n_reading;
+    int n_rssi = a_snapshot.n_signal;
+  #else
+    doorState n_state = n_doorState;
+    uint32_t n_since = n_lastEvent;
+    uint8_t n_reading = n_statusReading;
+    int n_rssi = n_statusSignal;
+  #endif
+    char s_time[10];
+    f_formatTime(Time.now() - n_since, s_time);
     sprintf(
-        s_doorStatus,
+        s_buffer,
         "status=%s|time=%s|sensor=%u|signal=%d",
-        f_translateState(n_doorState).c_str(),
+        f_translateState(n_state),
         s_time,
-        o_sensor->f_getLastReading(),
-        WiFi.RSSI()
+        n_reading,
+        n_rssi
     );
+    return s_buffer;
+}
+
+/**
+ * Renders door configuration variable on request
+ */
+const char* c_door::f_getConfig(char* s_buffer) {
+  #if APPTHREAD
+    doorSnapshot a_snapshot;
+    o_snapshot->f_read(a_snapshot);
+    strcpy(s_buffer, a_snapshot.s_config);
+  #else
+    o_config->f_render(s_buffer);
+  #endif
+    return s_buffer;
+}
+
+#if APPTHREAD
+const char* c_door::f_getPacked() {
+    doorSnapshot a_snapshot;
+    o_snapshot->f_read(a_snapshot);
+    strcpy(s_render, a_snapshot.s_packed);
+    return s_render;
+}
+
+const char* c_door::f_getDelta() {
+    doorSnapshot a_snapshot;
+    o_snapshot->f_read(a_snapshot);
+    strcpy(s_render, a_snapshot.s_delta);
+    return s_render;
+}
+
+/**
+ * Copies values served to the cloud once any of them has changed, the
+ *  configuration is rendered straight into the snapshot
+ */
+void c_door::f_syncSnapshot() {
+    if (!b_snapshotDirty)
+        return;
+    b_snapshotDirty = false;
+    doorSnapshot a_snapshot;
+    a_snapshot.n_state = n_doorState;
+    a_snapshot.n_reading = n_statusReading;
+    a_snapshot.n_signal = n_statusSignal;
+    a_snapshot.n_lastEvent = n_lastEvent;
+    strcpy(a_snapshot.s_packed, s_doorPacked);
+    strcpy(a_snapshot.s_delta, s_statusDelta);
+    o_config->f_render(a_snapshot.s_config);
+    o_snapshot->f_write(a_snapshot);
+}
+#endif
+
+/**
+ * Renders history page selected by @see f_getTelemetry() on request
+ */
+const char* c_door::f_getHistory() {
+    o_telemetry->f_render(s_render);
+    return s_render;
 }
 
+uint16_t* c_door::f_getLanPin() {
+    return &o_config->a_config.values.n_lanPin;
+}
+
+/**
+ * Generates packed status record, base64 of little endian fields:
+ *  version, sequence (2), state, last event time (4), sensor, signal.
+ *  Sequence number changes only when one of the fields does.
+ */
+void c_door::f_prepPacked() {
+
+    uint8_t n_changed = 0;
+    if (n_packedState != n_doorState) {
+        n_packedState = n_doorState;
+        n_changed |= PACKED_STATE;
+    }
+    if (n_packedEvent != (uint32_t)n_lastEvent) {
+        n_packedEvent = n_lastEvent;
+        n_changed |= PACKED_EVENT;
+    }
+    if (n_packedSensor != n_statusReading) {
+        n_packedSensor = n_statusReading;
+        n_changed |= PACKED_SENSOR;
+    }
+    if (n_packedSignal != n_statusSignal) {
+        n_packedSignal = n_statusSignal;
+        n_changed |= PACKED_SIGNAL;
+    }
+    if (!n_changed && n_packedSeq)
+        return;
+
+    n_packedSeq++;
+    for (uint8_t n_field = 0; n_field < 4; n_field++)
+        if (n_changed & (1 << n_field))
+            a_packedChanged[n_field] = n_packedSeq;
+
+    uint8_t a_record[10] = {
+        PACKED_VERSION,
+        (uint8_t)n_packedSeq,
+        (uint8_t)(n_packedSeq >> 8),
+        n_packedState,
+        (uint8_t)n_packedEvent,
+        (uint8_t)(n_packedEvent >> 8),
+        (uint8_t)(n_packedEvent >> 16),
+        (uint8_t)(n_packedEvent >> 24),
+        n_packedSensor,
+        (uint8_t)n_packedSignal
+    };
+    f_encodeBase64(a_record, sizeof(a_record), s_doorPacked);
+    f_prepDelta();
+}
+
+/**
+ * Generates delta record with fields changed since the sequence number set by
+ *  @see f_statusSince(): version, sequence (2), base sequence (2), field mask
+ *  followed by the changed fields in packed record order
+ */
+void c_door::f_prepDelta() {
+
+    uint8_t a_record[13] = {
+        PACKED_VERSION,
+        (uint8_t)n_packedSeq,
+        (uint8_t)(n_packedSeq >> 8),
+        (uint8_t)n_deltaBase,
+        (uint8_t)(n_deltaBase >> 8),
+        0
+    };
+    uint8_t n_length = 6;
+
+    for (uint8_t n_field = 0; n_field < 4; n_field++) {
+        // sequence numbers compared in rollover safe way
+        if ((int16_t)(a_packedChanged[n_field] - n_deltaBase) <= 0)
+            continue;
+        a_record[5] |= 1 << n_field;
+        switch (1 << n_field) {
+            case PACKED_STATE:
+                a_record[n_length++] = n_packedState;
+                break;
+            case PACKED_EVENT:
+                a_record[n_length++] = n_packedEvent;
+                a_record[n_length++] = n_packedEvent >> 8;
+                a_record[n_length++] = n_packedEvent >> 16;
+                a_record[n_length++] = n_packedEvent >> 24;
+                break;
+            case PACKED_SENSOR:
+                a_record[n_length++] = n_packedSensor;
+                break;
+            case PACKED_SIGNAL:
+                a_record[n_length++] = n_packedSignal;
+                break;
+        }
+    }
+    f_encodeBase64(a_record, n_length, s_statusDelta);
+    #if APPTHREAD
+        b_snapshotDirty = true;
+    #endif
+}
+
+/**
+ * Sets the sequence number deltas are calculated from, called by backend
+ *  after it processed the status with that sequence number. The base is
+ *  kept per door, not per client, so a single delta consumer is assumed:
+ *  other clients setting their own base change the mask it reads, they
+ *  should poll doorPacked instead
+ * @param[in] const char* s_seq Sequence number
+ * @return Number of fields changed since that sequence number
+ */
+int8_t c_door::f_statusSince(const char* s_seq) {
+    n_deltaBase = strtoul(s_seq, NULL, 10);
+    f_prepDelta();
+    int8_t n_fields = 0;
+    for (uint8_t n_field = 0; n_field < 4; n_field++)
+        if ((int16_t)(a_packedChanged[n_field] - n_deltaBase) > 0)
+            n_fields++;
+    return n_fields;
+}
+
+/**
+ * Selects page of sensor history rendered when telemetry variable is read
+ * @param[in] const char* s_request Level and page as "level:page"
+ * @return Number of pages at that level or -1 for invalid request
+ */
+int c_door::f_getTelemetry(const char* s_request) {
+    return o_telemetry->f_select(s_request);
+}
+
+/**
+ * Encodes binary data as null terminated base64 string
+ */
+void c_door::f_encodeBase64(const uint8_t* a_data, uint8_t n_length, char* s_encoded) {
+    static const char s_alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (uint8_t n_pos = 0; n_pos < n_length; n_pos += 3) {
+        uint32_t n_block = (uint32_t)a_data[n_pos] << 16;
+        if (n_pos + 1 < n_length)
+            n_block |= (uint32_t)a_data[n_pos + 1] << 8;
+        if (n_pos + 2 < n_length)
+            n_block |= a_data[n_pos + 2];
+        *s_encoded++ = s_alphabet[n_block >> 18 & 0x3F];
+        *s_encoded++ = s_alphabet[n_block >> 12 & 0x3F];
+        *s_encoded++ = n_pos + 1 < n_length ? s_alphabet[n_block >> 6 & 0x3F] : '=';
+        *s_encoded++ = n_pos + 2 < n_length ? s_alphabet[n_block & 0x3F] : '=';
+    }
+    *s_encoded = 0;
+}
+
+/**
+ * Samples WiFi signal strength at configured rate
+ */
+void c_door::f_sampleSignal() {
+
+    uint32_t n_now = Time.now();
+    if (n_signalSampled && n_now - n_signalSampled < o_config->a_config.values.n_signalTime)
+        return;
+    n_signalSampled = n_now;
+
+    if (!WiFi.ready())
+        return;
+    n_signal = WiFi.RSSI();
+}
+
+/**
+ * Generates the string for diagnostic counters variable
+ */
+void c_door::f_prepStats() {
+    PROFILE(PROFILE_STATS);
+
+    // lowest free heap seen is the high-water mark of runtime allocations
+    n_heapFree = System.freeMemory();
+    if (!n_heapMin || n_heapFree < n_heapMin)
+        n_heapMin = n_heapFree;
+    sprintf(
+        s_doorStats,
+        "scans=%lu|samples=%lu|lastSamples=%u|statusSkip=%lu|heapFree=%lu|heapMin=%lu|awake=%u|published=%lu|coalesced=%lu|dropped=%lu|outages=%lu|relayLatency=%lu|relayMaxLatency=%lu|relayDropped=%lu|travel=%u|scanTime=%u|scansHour=%lu",
+        (unsigned long)o_sensor->f_getTotalScans(),
+        (unsigned long)o_sensor->f_getTotalSamples(),
+        o_sensor->f_getLastSamples(),
+        (unsigned long)n_statusSkipped,
+        (unsigned long)n_heapFree,
+        (unsigned long)n_heapMin,
+        f_getAwakePercent(),
+        (unsigned long)o_publisher->f_getPublished(),
+        (unsigned long)o_publisher->f_getCoalesced(),
+        (unsigned long)o_publisher->f_getDropped(),
+        (unsigned long)o_publisher->f_getOutages(),
+        (unsigned long)o_relay->f_getLastLatency(),
+        (unsigned long)o_relay->f_getMaxLatency(),
+        (unsigned long)o_relay->f_getDropped(),
+        o_travel->f_getEstimate(),
+        n_scanInterval,
+        (unsigned long)n_scansPerHour
+    );
+    #if APPPROFILE
+        c_profiler::f_render(s_profile);
+    #endif
+}
+
+/**
+ * Reports duty cycle of the main loop
+ * @return Percentage of time spent awake, 100 if idle mode is not used
+ */
+uint8_t c_door::f_getAwakePercent() {
+    uint64_t n_total = n_idleTime + n_awakeTime;
+    return n_total ? n_awakeTime * 100 / n_total : 100;
+}
+
+/**
+ * Formats elapsed time in the largest practical units
+ */
 void c_door::f_formatTime(uint32_t n_time, char* s_time) {
   char s_units = 's';
   if (n_time >= 120) {
@@ -431,18 +1067,29 @@ void c_door::f_formatTime(uint32_t n_time, char* s_time) {
       }
     }
   }
-  sprintf(s_time, "%lu%c", n_time, s_units);
+  sprintf(s_time, "%lu%c", (unsigned long)n_time, s_units);
 }
 
 /**
  * Updates configuration from the string
  */
-int8_t c_door::f_setConfig(String s_config) {
+int8_t c_door::f_setConfig(const char* s_config) {
     int8_t n_result = o_config->f_set(s_config);
+    if (n_result > 0) {
+        char s_updates[5];
+        sprintf(s_updates, "%d", n_result);
+        f_publish("config", s_updates);
+    }
     // configure sensor
     o_sensor->f_setParams(
       o_config->a_config.values.n_sensorReads,
-      o_config->a_config.values.n_sensorThreshold
+      o_config->a_config.values.n_sensorThreshold,
+      o_config->a_config.values.n_sensorSequential
     );
+    // alert deadlines depend on configuration
+    f_processAlerts();
+    #if APPTHREAD
+        b_snapshotDirty = true;
+    #endif
     return n_result;
 }
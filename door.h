@@ -12,9 +12,36 @@
 
 #include "application.h"
 #include "config.h"
+#include "scheduler.h"
 #include "timeout.h"
 #include "sensor.h"
+#include "publisher.h"
+#include "relay.h"
+#include "telemetry.h"
+#include "travel.h"
+#include "alert.h"
+#include "script.h"
+#include "snapshot.h"
+#include "profiler.h"
 #include "global.h"
+#include "memory.h"
+
+typedef struct {
+    uint8_t n_laser;
+    uint8_t n_relay;
+    uint8_t n_photo;
+} doorPins;
+
+// door values read by the cloud thread with APPTHREAD
+typedef struct {
+    uint8_t n_state;
+    uint8_t n_reading;
+    int16_t n_signal;
+    uint32_t n_lastEvent;
+    char s_packed[17];
+    char s_delta[21];
+    char s_config[CONFIG_TEXTSIZE];
+} doorSnapshot;
 
 class c_door {
 
@@ -27,49 +54,196 @@ class c_door {
         STATE_UNKNOWN
     };
 
-    enum connState {
-        STATE_INITIAL,
-        STATE_DISCONNECTED,
-        STATE_CONNECTING,
-        STATE_CONNECTED,
+    // fields of packed status record, used as delta mask bits
+    enum packedField {
+        PACKED_STATE = 0x01,
+        PACKED_EVENT = 0x02,
+        PACKED_SENSOR = 0x04,
+        PACKED_SIGNAL = 0x08
     };
 
 protected:
-    char s_doorStatus[MAXVARSIZE];
-    char s_netConfig[MAXVARSIZE];
+    // door number, first door also handles device wide variables
+    uint8_t n_index;
+    char s_doorStats[MAXVARSIZE];
+    // base64 of 10 and up to 13 byte records
+    char s_doorPacked[17];
+    char s_statusDelta[21];
+#if APPPROFILE
+    // device wide, shared by all doors
+    static char s_profile[MAXVARSIZE];
+#endif
     long n_lastEvent = 0;
-    connState n_connState = STATE_INITIAL;
     doorState n_doorState = STATE_OPEN;
-    uint8_t n_relayClicksLeft;
-    bool b_alertFiredTimeout = false;
-    bool b_alertFiredNight = false;
+    bool b_motionCheck = false;
+    // motion timeout waits for the relay to finish queued presses
+    bool b_motionPending = false;
+    // current scan interval (mS) and scans counted for the hourly rate
+    uint16_t n_scanInterval = 0;
+    uint32_t n_hourStart = 0;
+    uint32_t n_hourScans = 0;
+    uint32_t n_scansPerHour = 0;
+    bool b_hourComplete = false;
+    bool b_alertsStarted = false;
+    // closing is timed from the relay press to closed sensor reading
+    bool b_travelTiming = false;
+    // script wait ended by timer, script steps are being executed
+    bool b_scriptExpired = false;
+    bool b_scriptRunning = false;
+
+    // packed status is regenerated only when displayed values change
+    bool b_statusDirty = true;
+    uint8_t n_statusReading = 0;
+    int n_statusSignal = 0;
+    int n_signal = 0;
+    uint32_t n_signalSampled = 0;
+    uint32_t n_statusSkipped = 0;
+
+    // text variables are rendered on request into one shared buffer which
+    // getters return as is, the platform copies it so reads do not allocate,
+    // calculated variables have no context so each door gets own getter
+    static char s_render[MAXVARSIZE];
+    static c_door* a_instances[DOOR_MAXCOUNT];
+    static const char* (* const a_statusVars[DOOR_MAXCOUNT])();
+    static const char* (* const a_configVars[DOOR_MAXCOUNT])();
+    static const char* (* const a_historyVars[DOOR_MAXCOUNT])();
+#if APPTHREAD
+    // requests are rendered by the cloud thread from the snapshot, packed
+    // records are rewritten by the door thread so they are served from it too
+    static const char* (* const a_packedVars[DOOR_MAXCOUNT])();
+    static const char* (* const a_deltaVars[DOOR_MAXCOUNT])();
+    c_snapshot<doorSnapshot> *o_snapshot = APPNEW(c_snapshot<doorSnapshot>)();
+    bool b_snapshotDirty = true;
+#endif
+    // packed status values and sequence numbers of their last change
+    uint16_t n_packedSeq = 0;
+    // set by the one backend consuming statusDelta, see f_statusSince()
+    uint16_t n_deltaBase = 0;
+    uint8_t n_packedState = STATE_UNKNOWN;
+    uint32_t n_packedEvent = 0;
+    uint8_t n_packedSensor = 0;
+    int8_t n_packedSignal = 0;
+    uint16_t a_packedChanged[4] = {0, 0, 0, 0};
 
-    c_config  *o_config = new c_config();
-    c_sensor  *o_sensor = new c_sensor();
-    c_timeout *o_scanTimeout = new c_timeout();
-    c_timeout *o_relayOnTimeout = new c_timeout();
-    c_timeout *o_relayOffTimeout = new c_timeout();
-    c_timeout *o_motionTimeout = new c_timeout();
+    uint32_t n_heapFree = 0;
+    uint32_t n_heapMin = 0;
+
+    // time spent idle and awake in microseconds
+    uint64_t n_idleTime = 0;
+    uint64_t n_awakeTime = 0;
+    uint32_t n_idleMark = 0;
+
+    // scheduler and publisher are shared by all doors, others are created
+    // by constructor in the declaration order
+    c_scheduler *o_scheduler;
+    c_publisher *o_publisher;
+    c_config  *o_config;
+    c_sensor  *o_sensor;
+    c_timeout *o_scanTimeout = APPNEW(c_timeout)(o_scheduler, f_onScanTimeout, this);
+    c_timeout *o_motionTimeout = APPNEW(c_timeout)(o_scheduler, f_onMotionTimeout, this);
+    c_relay *o_relay;
+    c_telemetry *o_telemetry;
+    c_travel *o_travel = APPNEW(c_travel)();
+    c_alerts *o_alerts = APPNEW(c_alerts)();
+    c_timeout *o_alertTimeout = APPNEW(c_timeout)(o_scheduler, f_onAlertTimeout, this);
+    c_script *o_script = APPNEW(c_script)();
+    c_timeout *o_scriptTimeout = APPNEW(c_timeout)(o_scheduler, f_onScriptTimeout, this);
+
+    // scheduler callbacks
+    static void f_onScanTimeout(void* p_door);
+    static void f_onMotionTimeout(void* p_door);
+    static void f_onAlertTimeout(void* p_door);
+    static void f_onScriptTimeout(void* p_door);
 
     void f_motionTimeout();
-    void f_relayOn(uint8_t n_clicks = 0);
-    void f_relayOff();
-    doorState f_translateState(String s_state);
-    String f_translateState(doorState n_state);
+    void f_startMotion(uint8_t n_clicks);
+    void f_armMotion();
+    void f_scheduleScan(bool b_changed);
+    void f_fastScan();
+    void f_countScan();
+    uint16_t f_getFastInterval();
+    void f_motionCheck();
+    static doorState f_translateState(const char* s_state);
+    static bool f_isState(const char* s_state);
+    const char* f_translateState(doorState n_state);
     void f_publishState();
-    bool f_prepNetConfig();
+    void f_publish(const char* s_event, const char* s_data, bool b_coalesce = FALSE);
     void f_prepStatus();
+    static const char* f_netConfigVar();
+    template <uint8_t N> static const char* f_statusVar() {
+        return a_instances[N]->f_getStatus();
+    }
+    template <uint8_t N> static const char* f_configVar() {
+        return a_instances[N]->f_getConfig();
+    }
+    template <uint8_t N> static const char* f_historyVar() {
+        return a_instances[N]->f_getHistory();
+    }
+#if APPTHREAD
+    template <uint8_t N> static const char* f_packedVar() {
+        return a_instances[N]->f_getPacked();
+    }
+    template <uint8_t N> static const char* f_deltaVar() {
+        return a_instances[N]->f_getDelta();
+    }
+#endif
+    void f_prepStats();
+    void f_prepPacked();
+    void f_prepDelta();
+    static void f_encodeBase64(const uint8_t* a_data, uint8_t n_length, char* s_encoded);
+    uint8_t f_getAwakePercent();
+    void f_sampleSignal();
     void f_formatTime(uint32_t n_time, char* s_time);
-    void f_processAlertTimeout();
-    void f_processAlertNight();
+    void f_updateAlerts();
+    void f_processAlerts();
+    void f_runScript();
+    void f_stopScript();
 
  public:
-    c_door();
+/**
+ * Door constructor
+ * @param[in] uint8_t n_door Door index
+ * @param[in] const doorPins& a_pins Pin assignments
+ * @param[in] c_scheduler* o_doorScheduler Scheduler shared by all doors
+ * @param[in] c_publisher* o_doorPublisher Event publisher shared by all doors
+ */
+    c_door(uint8_t n_door, const doorPins& a_pins, c_scheduler *o_doorScheduler, c_publisher *o_doorPublisher);
     void f_process();
+    void f_idle();
     doorState f_getState();
     doorState f_setState(doorState n_requestedState);
-    signed char f_setState(String s_request);
-    int8_t f_setConfig(String s_config);
+/**
+ * Processes state request or script, see script.h
+ * @return 0 for plain state request, script id for script, -1 if invalid
+ */
+    int f_setState(const char* s_request);
+    int8_t f_setConfig(const char* s_config);
+    int8_t f_statusSince(const char* s_seq);
+    int f_getTelemetry(const char* s_request);
+
+/**
+ * Renders status and configuration variables into shared buffer
+ * @param[out] char* s_buffer MAXVARSIZE bytes, callers on another thread
+ *  than cloud variables pass their own
+ * @return text valid until the next variable is rendered
+ */
+    const char* f_getStatus(char* s_buffer = s_render);
+    const char* f_getConfig(char* s_buffer = s_render);
+    const char* f_getHistory();
+#if APPTHREAD
+    const char* f_getPacked();
+    const char* f_getDelta();
+
+/**
+ * Publishes changed door values to the cloud thread, door thread only
+ */
+    void f_syncSnapshot();
+#endif
+
+/**
+ * Provides local network pin setting
+ */
+    uint16_t* f_getLanPin();
 };
 
 #endif
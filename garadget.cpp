@@ -14,38 +14,260 @@
 #include "application.h"
 #include "global.h"
 #include "door.h"
+#include "scheduler.h"
+#include "publisher.h"
+#include "profiler.h"
+#include "memory.h"
+#include "trace.h"
+#include "lan.h"
+#include "mailbox.h"
 
 // Particle platform - product settings
 PRODUCT_ID(PROD_ID);
 PRODUCT_VERSION(VERSION_MAJOR*100+VERSION_MINOR);
 
+#if APPTHREAD
+    // cloud is processed by system thread and loop(), doors by own thread
+    SYSTEM_THREAD(ENABLED);
+    // door thread is served first so relay and scan timing hold under load
+    #define THREAD_PRIORITY (OS_THREAD_PRIORITY_DEFAULT + 1)
+#endif
 
-c_door* o_door;
+
+c_scheduler* o_scheduler;
+c_publisher* o_publisher;
+c_door* a_doors[DOOR_COUNT];
+#if APPLAN
+    c_lan* o_lan;
+#endif
+#if APPTHREAD
+    c_mailbox* o_mailbox;
+    Thread* o_doorThread;
+#endif
+
+/**
+ * Resolves door addressed by optional "n:" prefix of the cloud function
+ *  argument, arguments without prefix address the first door
+ * @param[in,out] const char*& s_args Argument string, advanced past prefix
+ * @return door object or NULL if index is invalid
+ */
+c_door* f_getDoor(const char*& s_args) {
+    if (s_args[0] >= '1' && s_args[0] <= '9' && s_args[1] == ':') {
+        uint8_t n_door = s_args[0] - '1';
+        s_args += 2;
+        return (n_door < DOOR_COUNT) ? a_doors[n_door] : NULL;
+    }
+    return a_doors[0];
+}
+
+/**
+ * Executes door command, on the door thread with APPTHREAD
+ * @return command result or -1 if door index is invalid
+ */
+int f_runCommand(mailboxCommand n_command, const char* s_args) {
+    c_door* o_door = f_getDoor(s_args);
+    if (!o_door)
+        return -1;
+    int n_result = -1;
+    switch (n_command) {
+        case COMMAND_SETSTATE:
+            n_result = o_door->f_setState(s_args);
+            break;
+        case COMMAND_SETCONFIG:
+            n_result = o_door->f_setConfig(s_args);
+            #ifdef APPDEBUG
+                Serial.print("Config update result: ");
+                Serial.println(n_result);
+            #endif
+            break;
+        case COMMAND_STATUSSINCE:
+            n_result = o_door->f_statusSince(s_args);
+            break;
+        case COMMAND_TELEMETRY:
+            n_result = o_door->f_getTelemetry(s_args);
+            break;
+    }
+    // caller reads variables right after the function returns
+    #if APPTHREAD
+        o_door->f_syncSnapshot();
+    #endif
+    return n_result;
+}
+
+/**
+ * Passes command to the door thread and waits for the result with
+ *  APPTHREAD, executes it right away otherwise
+ */
+int f_command(mailboxCommand n_command, const char* s_args) {
+    #if APPTHREAD
+        return o_mailbox->f_call(n_command, s_args);
+    #else
+        return f_runCommand(n_command, s_args);
+    #endif
+}
+
+// commands are shared by cloud functions and local network endpoint
+
+int f_cmdSetState(const char* s_args) {
+    TRACE_COMMAND("setState", s_args);
+    return f_command(COMMAND_SETSTATE, s_args);
+}
+
+int f_cmdSetConfig(const char* s_args) {
+    TRACE_COMMAND("setConfig", s_args);
+    return f_command(COMMAND_SETCONFIG, s_args);
+}
+
+int f_cmdStatusSince(const char* s_args) {
+    return f_command(COMMAND_STATUSSINCE, s_args);
+}
+
+int f_cmdTelemetry(const char* s_args) {
+    return f_command(COMMAND_TELEMETRY, s_args);
+}
 
 int f_doorSetState(String s_command) {
-    return o_door->f_setState(s_command);
+    return f_cmdSetState(s_command.c_str());
 }
 
 int f_setConfig(String s_config) {
-    int n_updates = o_door->f_setConfig(s_config);
-    if (n_updates > 0)
-        Particle.publish("config", String(n_updates), 60, PRIVATE);
-    #ifdef APPDEBUG
-        Serial.print("Config update result: ");
-        Serial.println(n_updates);
-    #endif
-    return n_updates;
+    return f_cmdSetConfig(s_config.c_str());
 }
 
+int f_statusSince(String s_seq) {
+    return f_cmdStatusSince(s_seq.c_str());
+}
+
+int f_getTelemetry(String s_request) {
+    return f_cmdTelemetry(s_request.c_str());
+}
+
+#if APPLAN
+// rendered into the buffer of the endpoint, not the shared door buffer
+void f_varStatus(const char* s_args, char* s_buffer) {
+    c_door* o_door = f_getDoor(s_args);
+    if (o_door)
+        o_door->f_getStatus(s_buffer);
+    else
+        *s_buffer = 0;
+}
+
+void f_varConfig(const char* s_args, char* s_buffer) {
+    c_door* o_door = f_getDoor(s_args);
+    if (o_door)
+        o_door->f_getConfig(s_buffer);
+    else
+        *s_buffer = 0;
+}
+#endif
+
+#if APPTHREAD
+/**
+ * Door thread, takes over door handling from loop()
+ */
+void f_doorThread(void* p_param) {
+    while (true) {
+        o_mailbox->f_serve(f_runCommand);
+        {
+            PROFILE(PROFILE_SCHEDULER);
+            o_scheduler->f_process();
+        }
+        for (uint8_t n_door = 0; n_door < DOOR_COUNT; n_door++)
+            a_doors[n_door]->f_process();
+        a_doors[0]->f_idle();
+    }
+}
+#endif
+
 void setup() {
     #ifdef APPDEBUG
         Serial.begin(115200);
     #endif
-    o_door = new c_door();
+    const doorPins a_pins[] = DOOR_PINS;
+    static_assert(DOOR_COUNT <= sizeof(a_pins) / sizeof(a_pins[0]), "DOOR_PINS has fewer entries than DOOR_COUNT");
+
+    o_scheduler = APPNEW(c_scheduler)();
+    #if APPTHREAD
+        // scheduler belongs to the door thread, publisher is polled by loop()
+        o_mailbox = APPNEW(c_mailbox)();
+        o_publisher = APPNEW(c_publisher)(NULL);
+    #else
+        o_publisher = APPNEW(c_publisher)(o_scheduler);
+    #endif
+    for (uint8_t n_door = 0; n_door < DOOR_COUNT; n_door++)
+        a_doors[n_door] = APPNEW(c_door)(n_door, a_pins[n_door], o_scheduler, o_publisher);
+
     Particle.function("setState", f_doorSetState);
     Particle.function("setConfig", f_setConfig);
+    Particle.function("statusSince", f_statusSince);
+    Particle.function("telemetry", f_getTelemetry);
+
+    #if APPLAN
+        o_lan = APPNEW(c_lan)(a_doors[0]->f_getLanPin());
+        o_lan->f_function("setState", f_cmdSetState);
+        o_lan->f_function("setConfig", f_cmdSetConfig);
+        o_lan->f_function("statusSince", f_cmdStatusSince);
+        o_lan->f_function("telemetry", f_cmdTelemetry);
+        o_lan->f_variable("doorStatus", f_varStatus);
+        o_lan->f_variable("doorConfig", f_varConfig, true);
+    #endif
+
+    #if APPTHREAD
+        o_doorThread = APPNEW(Thread)("door", f_doorThread, NULL, THREAD_PRIORITY);
+    #endif
+
+    // no firmware object is created past this point
+    c_memory::f_seal();
+    c_memory::f_print();
 }
 
 void loop() {
-    o_door->f_process();
+    {
+        PROFILE(PROFILE_LOOP);
+        {
+            PROFILE(PROFILE_CLOUD);
+            Particle.process();
+            // notices connection changes and flushes events stored offline
+            o_publisher->f_send();
+            #if APPLAN
+                o_lan->f_process();
+            #endif
+        }
+
+        // relay clicks, scan starts and motion timeouts are handled by callbacks
+        #if !APPTHREAD
+        {
+            PROFILE(PROFILE_SCHEDULER);
+            o_scheduler->f_process();
+        }
+        #endif
+
+        // debug console: 'p' prints profiler statistics, 't' the trace
+        #if (APPPROFILE || APPTRACE) && defined(APPDEBUG)
+            switch (Serial.available() ? Serial.read() : 0) {
+                #if APPPROFILE
+                    case 'p':
+                        c_profiler::f_print();
+                        break;
+                #endif
+                #if APPTRACE
+                    case 't':
+                        c_trace::f_print();
+                        break;
+                #endif
+            }
+        #endif
+
+        #if !APPTHREAD
+            for (uint8_t n_door = 0; n_door < DOOR_COUNT; n_door++)
+                a_doors[n_door]->f_process();
+        #endif
+    }
+
+    // idle accounting is device wide, kept by the first door
+    #if APPTHREAD
+        delay(THREAD_LOOPTIME);
+    #elif APPIDLE
+        a_doors[0]->f_idle();
+    #endif
 }
@@ -6,7 +6,7 @@
 
 // firmware version for EEPROM data integrity check
 #define VERSION_MAJOR 0x01
-#define VERSION_MINOR 0x04
+#define VERSION_MINOR 0x09
 
 // boolean constants
 //#define FALSE 0x00
@@ -18,18 +18,82 @@
 // switches in simulated door mode
 #define APPVIRTUAL FALSE
 
+// relay edges are driven by hardware timer interrupt instead of scheduler
+// requires SparkIntervalTimer library
+#define APPRELAYISR FALSE
+
+// collects execution time statistics of main loop sections
+#define APPPROFILE FALSE
+
+// main loop idles until the next scheduled event instead of spinning
+#define APPIDLE TRUE
+// longest idle period (mS), bounds the delay of cloud calls which are only
+// serviced between idle periods
+#define IDLE_MAXTIME 100
+
+// sensor samples are taken by hardware timer interrupt instead of main loop
+// requires SparkIntervalTimer library
+#define APPSENSORISR FALSE
+
+// long lived objects are placed into static pool instead of heap, see
+// memory.h for the pool size and per object RAM budgets
+#define APPSTATIC TRUE
+
+// records sensor samples, commands and published events for offline replay
+// dumped on 't' from debug console, see trace.h and replay/
+#define APPTRACE FALSE
+
+// serves cloud functions and variables to the local network over UDP,
+// see lan.h for the protocol
+#define APPLAN FALSE
+
+// doors run on their own thread, main loop only serves cloud and local
+// network, see mailbox.h and snapshot.h for the handoff between them
+#define APPTHREAD FALSE
+// pause between cloud loop passes with APPTHREAD (mS)
+#define THREAD_LOOPTIME 5
+
+#if APPTHREAD && APPTRACE
+    #error "trace recorder is not thread safe, disable APPTRACE with APPTHREAD"
+#endif
+#if APPTHREAD && !APPIDLE
+    #error "door thread has to idle for the cloud thread to run, enable APPIDLE with APPTHREAD"
+#endif
+
 // maximum payload size for variable according to spark.io documentation
 #define MAXVARSIZE 622
 
+// version of the packed doorPacked/statusDelta record layout
+#define PACKED_VERSION 0x01
+
+// number of doors handled by the controller, up to DOOR_MAXCOUNT
+#define DOOR_COUNT 1
+#define DOOR_MAXCOUNT 3
+// builds per door cloud variable, function or event name, first door uses
+// the base name and others get door number appended (e.g. doorStatus2),
+// s_name must be an array, too long name is truncated
+#define DOOR_NAME(s_name, s_base, n_index) \
+    snprintf(s_name, sizeof(s_name), (n_index) ? "%s%u" : "%s", s_base, (unsigned)(n_index) + 1)
+
 // pin assignments
 #define PIN_LASER D2
 #define PIN_RELAY D3
 #define PIN_PHOTO A0
+// pin assignments of all doors: laser, relay, photo sensor
+#define DOOR_PINS { \
+    {PIN_LASER, PIN_RELAY, PIN_PHOTO}, \
+    {D4, D5, A1}, \
+    {D6, D7, A2} \
+}
 
-// delay between sensor scans (mS)
+// delay between sensor scans while the door is idle (mS)
 // more frequent scans result in faster status update but blinking may be
 // irritating to the consumer
 #define DEFAULT_READTIME 1000
+// delay between sensor scans while the door is moving (mS)
+// scan delay doubles with every scan once the state is stable, up to the
+// idle delay above
+#define DEFAULT_READFAST 250
 // expected time for the door to complete full open or close (mS)
 // should be set to how long it takes for the door to fully open
 #define DEFAULT_MOTIONTIME 10000
@@ -46,13 +110,24 @@
 // can be adjusted down if target is too far but this can result in false
 // positives if objects cross the beam closer to the device
 #define DEFAULT_SENSORTRESHOLD 25
+// stop sensor reads early once the result is unambiguous (0-1)
+// number of sensor reads becomes the maximum for borderline readings
+#define DEFAULT_SENSORSEQUENTIAL 1
+// time in seconds between WiFi signal strength samples
+#define DEFAULT_SIGNALTIME 30
 // time in seconds for door to remain open before alert is sent
 // 0 disables the alert
 #define DEFAULT_ALERTOPENTIMEOUT 20*60
+// time in seconds between repeated timeout alerts while door stays open
+// 0 disables reminders
+#define DEFAULT_ALERTOPENREMINDER 0
 // time in minutes for beginning and end of night alert timeframe
 // equal values disable alert
 #define DEFAULT_ALERTNIGHTSTART 22*60
 #define DEFAULT_ALERTNIGHTEND 06*60
 // timezone's offset from UTC in hours
-#define DEFAULT_TIMEZONE -7.0;
+#define DEFAULT_TIMEZONE -7.0
+// pin authorizing local network clients, setting of the first door applies
+// 0 disables local control
+#define DEFAULT_LANPIN 0
 #endif
@@ -0,0 +1,280 @@
+// $Id$
+/**
+ * @file lan.cpp
+ * @brief Local network control endpoint
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "lan.h"
+
+#if APPLAN
+
+c_lan* c_lan::o_instance = NULL;
+
+/** constructor */
+c_lan::c_lan(uint16_t* p_lanPin) : p_pin(p_lanPin) {
+    for (uint8_t n_peer = 0; n_peer < LAN_MAXPEERS; n_peer++)
+        a_peers[n_peer].n_port = 0;
+    // datagrams go straight to request buffer, UDP does not allocate own
+    o_udp.setBuffer(LAN_REQUESTSIZE, a_request);
+    o_instance = this;
+}
+
+void c_lan::f_function(const char* s_name, int (*f_handler)(const char*)) {
+    if (n_handlers == LAN_MAXHANDLERS)
+        return;
+    a_handlers[n_handlers++] = {s_name, f_handler, NULL, true};
+}
+
+void c_lan::f_variable(const char* s_name, void (*f_getter)(const char*, char*), bool b_private) {
+    // name and value have to fit the reply buffer together
+    if (n_handlers == LAN_MAXHANDLERS || strlen(s_name) >= LAN_REPLYSIZE - MAXVARSIZE)
+        return;
+    a_handlers[n_handlers++] = {s_name, NULL, f_getter, b_private};
+}
+
+void c_lan::f_process() {
+    // socket is lost with the network, reopened once it is back
+    if (!WiFi.ready()) {
+        b_started = false;
+        return;
+    }
+    if (!b_started) {
+        o_udp.begin(LAN_PORT);
+        b_started = true;
+    }
+
+    // bounded so a flood of requests can not starve the doors
+    for (uint8_t n_request = 0; n_request < LAN_MAXREQUESTS; n_request++) {
+        int n_size = o_udp.receivePacket(a_request, LAN_REQUESTSIZE);
+        if (n_size < 0) {
+            o_udp.stop();
+            b_started = false;
+            return;
+        }
+        if (!n_size)
+            return;
+        a_request[n_size] = 0;
+        f_handle((char*)a_request, o_udp.remoteIP(), o_udp.remotePort());
+    }
+}
+
+/**
+ * Serves one request, the request buffer is split in place into name and
+ *  argument
+ */
+void c_lan::f_handle(char* s_request, IPAddress a_ip, uint16_t n_port) {
+    s_request[strcspn(s_request, "\r\n")] = 0;
+    lanPeer* a_peer = f_findPeer(a_ip, n_port, false);
+
+    if (!strcmp(s_request, "hello")) {
+        if (!*p_pin || f_isHeldOff(a_ip) || !(a_peer = f_findPeer(a_ip, n_port, true))) {
+            f_reply(a_ip, n_port, s_request, "denied");
+            return;
+        }
+        // new session, earlier signatures can not be replayed into it
+        char s_nonce[9];
+        a_peer->n_nonce = HAL_RNG_GetRandomNumber();
+        a_peer->n_counter = 0;
+        a_peer->b_auth = false;
+        a_peer->b_watch = false;
+        a_peer->n_seen = millis();
+        sprintf(s_nonce, "%08lx", (unsigned long)a_peer->n_nonce);
+        f_reply(a_ip, n_port, s_request, s_nonce);
+        return;
+    }
+
+    bool b_signed = false;
+    if (*s_request == '@') {
+        char* s_signed = f_verify(s_request, a_peer);
+        if (!s_signed) {
+            // reply names the request when it can be found
+            char* s_name = strchr(s_request, ' ');
+            s_name = s_name ? s_name + 1 : s_request;
+            s_name[strcspn(s_name, " ")] = 0;
+            f_reply(a_ip, n_port, s_name, "denied");
+            return;
+        }
+        s_request = s_signed;
+        b_signed = true;
+    }
+
+    char* s_arg = strchr(s_request, ' ');
+    if (s_arg)
+        *s_arg++ = 0;
+    else
+        s_arg = s_request + strlen(s_request);
+
+    if (!strcmp(s_request, "auth") || !strcmp(s_request, "watch")) {
+        if (b_signed && *s_request == 'w')
+            a_peer->b_watch = true;
+        f_reply(a_ip, n_port, s_request, b_signed ? "ok" : "denied");
+        return;
+    }
+
+    for (uint8_t n_handler = 0; n_handler < n_handlers; n_handler++) {
+        lanHandler* a_handler = &a_handlers[n_handler];
+        if (strcmp(s_request, a_handler->s_name))
+            continue;
+        if (a_handler->b_private && !b_signed) {
+            f_reply(a_ip, n_port, s_request, "denied");
+            return;
+        }
+        if (a_handler->f_function) {
+            char s_result[12];
+            sprintf(s_result, "%d", a_handler->f_function(s_arg));
+            f_reply(a_ip, n_port, s_request, s_result);
+        }
+        else {
+            // rendered behind the name in the reply buffer, cloud variables
+            // may be rendered into the shared door buffer at the same time
+            int n_length = sprintf(s_reply, "%s ", s_request);
+            a_handler->f_variable(s_arg, s_reply + n_length);
+            o_udp.sendPacket((uint8_t*)s_reply, strlen(s_reply), a_ip, n_port);
+        }
+        return;
+    }
+    f_reply(a_ip, n_port, s_request, "unknown");
+}
+
+/**
+ * Checks signature and counter of signed request, failures hold off the
+ *  sender's address
+ * @param[in] char* s_request Request starting with "@<counter>:<signature> "
+ * @return request without the signature or NULL if not valid
+ */
+char* c_lan::f_verify(char* s_request, lanPeer* a_peer) {
+    // no session, nothing to guess against
+    if (!a_peer || !*p_pin || f_isHeldOff(a_peer->a_ip))
+        return NULL;
+
+    char* s_end;
+    unsigned long n_counter = strtoul(s_request + 1, &s_end, 10);
+    char* s_mac = s_end + 1;
+    char* s_signed = s_mac + LAN_MACSIZE * 2;
+    bool b_valid = isdigit(s_request[1]) && *s_end == ':' && n_counter <= 0xffffffffUL
+        && strnlen(s_mac, LAN_MACSIZE * 2) == LAN_MACSIZE * 2 && *s_signed == ' '
+        && n_counter > a_peer->n_counter;
+    if (b_valid) {
+        // reply buffer is free until the request is served
+        char s_key[6];
+        uint8_t a_mac[SHA256_SIZE];
+        sprintf(s_key, "%u", (unsigned)*p_pin);
+        int n_length = snprintf(s_reply, LAN_REPLYSIZE, "%08lx:%lu:%s",
+            (unsigned long)a_peer->n_nonce, n_counter, s_signed + 1);
+        c_sha256::f_hmac(s_key, strlen(s_key), s_reply, n_length, a_mac);
+        // compared in full so timing does not reveal matching digits
+        uint8_t n_diff = 0;
+        for (uint8_t n_byte = 0; n_byte < LAN_MACSIZE * 2; n_byte++) {
+            uint8_t n_digit = (a_mac[n_byte / 2] >> (n_byte & 1 ? 0 : 4)) & 0x0f;
+            n_diff |= tolower(s_mac[n_byte]) ^ "0123456789abcdef"[n_digit];
+        }
+        b_valid = !n_diff;
+    }
+    if (!b_valid) {
+        if (a_peer->n_failures < LAN_MAXBACKOFF + 1)
+            a_peer->n_failures++;
+        a_peer->n_failed = millis();
+        return NULL;
+    }
+    a_peer->n_counter = n_counter;
+    a_peer->n_failures = 0;
+    a_peer->b_auth = true;
+    a_peer->n_seen = millis();
+    return s_signed + 1;
+}
+
+/**
+ * Reports if the address failed a signature recently, the delay doubles
+ *  with every failure
+ */
+bool c_lan::f_isHeldOff(IPAddress a_ip) {
+    uint32_t n_now = millis();
+    for (uint8_t n_peer = 0; n_peer < LAN_MAXPEERS; n_peer++) {
+        lanPeer* a_peer = &a_peers[n_peer];
+        if (a_peer->n_port && a_peer->a_ip == a_ip && a_peer->n_failures
+        && n_now - a_peer->n_failed < (uint32_t)LAN_AUTHDELAY << (a_peer->n_failures - 1))
+            return true;
+    }
+    return false;
+}
+
+bool c_lan::f_isExpired(lanPeer* a_peer, uint32_t n_now) {
+    return n_now - a_peer->n_seen > (a_peer->b_auth ? LAN_LEASE : LAN_HELLOLEASE) * 1000UL;
+}
+
+/**
+ * Looks up sender, expired entries are dropped on the way
+ * @param[in] bool b_add Adds sender if not found, replacing the least
+ *  recently seen session not signed in yet when the table is full. New
+ *  entry takes over failures of the address so changing port does not
+ *  reset the delay.
+ * @return peer or NULL if not found and not added
+ */
+c_lan::lanPeer* c_lan::f_findPeer(IPAddress a_ip, uint16_t n_port, bool b_add) {
+    uint32_t n_now = millis();
+    lanPeer* a_free = NULL;
+    lanPeer* a_failed = NULL;
+    for (uint8_t n_peer = 0; n_peer < LAN_MAXPEERS; n_peer++) {
+        lanPeer* a_peer = &a_peers[n_peer];
+        // failures are kept while they still hold off the address
+        if (a_peer->n_port && f_isExpired(a_peer, n_now)
+        && !(a_peer->n_failures && n_now - a_peer->n_failed < (uint32_t)LAN_AUTHDELAY << (a_peer->n_failures - 1)))
+            a_peer->n_port = 0;
+        if (a_peer->n_port == n_port && a_peer->a_ip == a_ip)
+            return a_peer;
+        if (a_peer->n_port && a_peer->a_ip == a_ip && (!a_failed || a_peer->n_failures > a_failed->n_failures))
+            a_failed = a_peer;
+        // authorized sessions are never replaced
+        if (a_peer->n_port && a_peer->b_auth)
+            continue;
+        // empty slot, otherwise the one seen longest ago
+        if (!a_free || (a_free->n_port && (!a_peer->n_port || n_now - a_peer->n_seen > n_now - a_free->n_seen)))
+            a_free = a_peer;
+    }
+    if (!b_add || !a_free)
+        return NULL;
+    if (a_failed && a_failed != a_free) {
+        a_free->n_failures = a_failed->n_failures;
+        a_free->n_failed = a_failed->n_failed;
+    }
+    else if (a_failed != a_free)
+        a_free->n_failures = 0;
+    a_free->a_ip = a_ip;
+    a_free->n_port = n_port;
+    a_free->b_auth = false;
+    a_free->b_watch = false;
+    a_free->n_counter = 0;
+    a_free->n_seen = n_now;
+    return a_free;
+}
+
+void c_lan::f_reply(IPAddress a_ip, uint16_t n_port, const char* s_name, const char* s_result) {
+    int n_length = snprintf(s_reply, LAN_REPLYSIZE, "%s %s", s_name, s_result);
+    if (n_length >= LAN_REPLYSIZE)
+        n_length = LAN_REPLYSIZE - 1;
+    o_udp.sendPacket((uint8_t*)s_reply, n_length, a_ip, n_port);
+}
+
+void c_lan::f_sendEvent(const char* s_name, const char* s_data) {
+    if (!b_started)
+        return;
+    uint32_t n_now = millis();
+    for (uint8_t n_peer = 0; n_peer < LAN_MAXPEERS; n_peer++) {
+        lanPeer* a_peer = &a_peers[n_peer];
+        if (!a_peer->n_port || !a_peer->b_watch || f_isExpired(a_peer, n_now))
+            continue;
+        char s_event[LAN_REQUESTSIZE];
+        snprintf(s_event, sizeof(s_event), "event %s", s_name);
+        f_reply(a_peer->a_ip, a_peer->n_port, s_event, s_data);
+    }
+}
+
+void c_lan::f_push(const char* s_name, const char* s_data) {
+    if (o_instance)
+        o_instance->f_sendEvent(s_name, s_data);
+}
+
+#endif
@@ -0,0 +1,159 @@
+// $Id$
+/**
+ * @file lan.h
+ * @brief Local network control endpoint
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Serves the same functions and variables as the cloud to clients on the
+ * local network over UDP, so control does not depend on the internet. Each
+ * datagram carries one request "<name> [argument]" and gets one reply
+ * "<name> <result>":
+ *  hello              starts session of the sender, reply carries the
+ *                     session nonce "hello <nonce>" or "hello denied" when
+ *                     the pin is not set, the sender is held off or the
+ *                     table is full of authorized senders
+ *  auth               checks signature, "ok" when valid
+ *  watch              subscribes sender to events
+ *  setState, setConfig, ...   functions as in the cloud, result is the
+ *                     return value
+ *  doorStatus, ...    variables as in the cloud, door prefix "n:" applies
+ * Everything except hello and public variables has to be signed, unsigned
+ * or badly signed requests get "denied". A signed request is sent as
+ *  @<counter>:<signature> <name> [argument]
+ * where counter is decimal, higher than in the previous request of the
+ * session, and signature is the first LAN_MACSIZE bytes in hex of
+ * HMAC-SHA256 of "<nonce>:<counter>:<name> [argument]" keyed with the lpn
+ * setting of the first door in decimal. Setting it to 0 disables signed
+ * requests. Each request is authorized on its own, so packets forged with
+ * the address of an authorized sender or replayed are refused.
+ * Failed signatures hold off hello and signed requests from the sender's
+ * address for LAN_AUTHDELAY, doubled with every further failure up to
+ * LAN_MAXBACKOFF times, other senders are not affected. The pin is short,
+ * so anyone who captures a signed request can still find it offline, the
+ * signature keeps out senders who can not see the traffic.
+ * Sessions last LAN_LEASE seconds after the last signed request and
+ * subscribed ones receive every event published by doors as
+ * "event <name> <data>". Sessions not signed in within LAN_HELLOLEASE are
+ * dropped, and only those are replaced when the table is full.
+ * Requests are received into and replies sent from fixed buffers of the
+ * object, nothing is allocated per request. With APPLAN disabled the
+ * endpoint is not compiled and LAN_PUSH expands to nothing.
+ */
+// $Log$
+
+#ifndef LAN_H
+#define LAN_H
+
+#include "application.h"
+#include "global.h"
+
+#if APPLAN
+
+#include "sha256.h"
+
+// UDP port of the endpoint
+#define LAN_PORT 5566
+// longest request (bytes), fits signature and the longest argument
+#define LAN_REQUESTSIZE 192
+// longest reply (bytes), fits the largest variable
+#define LAN_REPLYSIZE (MAXVARSIZE + 32)
+// number of sessions
+#define LAN_MAXPEERS 4
+// time a session lasts after its last signed request (S)
+#define LAN_LEASE 300
+// time a session lasts before the first signed request (S)
+#define LAN_HELLOLEASE 30
+// maximum number of functions and variables
+#define LAN_MAXHANDLERS 8
+// requests served per main loop pass
+#define LAN_MAXREQUESTS 4
+// time signed requests are refused after a failed signature (mS)
+#define LAN_AUTHDELAY 1000
+// most doublings of LAN_AUTHDELAY on repeated failures
+#define LAN_MAXBACKOFF 10
+// signature bytes sent with the request, truncated HMAC-SHA256
+#define LAN_MACSIZE 16
+
+class c_lan {
+
+    typedef struct {
+        const char* s_name;
+        int (*f_function)(const char*);
+        void (*f_variable)(const char*, char*);
+        bool b_private;
+    } lanHandler;
+
+    typedef struct {
+        IPAddress a_ip;
+        uint16_t n_port;
+        // signed request accepted in this session
+        bool b_auth;
+        bool b_watch;
+        uint8_t n_failures;
+        uint32_t n_failed;
+        uint32_t n_nonce;
+        uint32_t n_counter;
+        uint32_t n_seen;
+    } lanPeer;
+
+protected:
+    // events are pushed through the only instance
+    static c_lan* o_instance;
+
+    UDP o_udp;
+    bool b_started = false;
+    uint16_t* p_pin;
+    uint8_t a_request[LAN_REQUESTSIZE + 1];
+    char s_reply[LAN_REPLYSIZE];
+    lanHandler a_handlers[LAN_MAXHANDLERS];
+    uint8_t n_handlers = 0;
+    lanPeer a_peers[LAN_MAXPEERS];
+
+    void f_handle(char* s_request, IPAddress a_ip, uint16_t n_port);
+    char* f_verify(char* s_request, lanPeer* a_peer);
+    bool f_isHeldOff(IPAddress a_ip);
+    bool f_isExpired(lanPeer* a_peer, uint32_t n_now);
+    lanPeer* f_findPeer(IPAddress a_ip, uint16_t n_port, bool b_add);
+    void f_reply(IPAddress a_ip, uint16_t n_port, const char* s_name, const char* s_result);
+    void f_sendEvent(const char* s_name, const char* s_data);
+
+public:
+/**
+ * Endpoint constructor
+ * @param[in] uint16_t* p_lanPin Configured pin, read on every signed request
+ */
+    c_lan(uint16_t* p_lanPin);
+
+/**
+ * Registers function, called with argument of the request
+ */
+    void f_function(const char* s_name, int (*f_handler)(const char*));
+
+/**
+ * Registers variable, getter is called with argument of the request and
+ *  renders the text into a buffer of MAXVARSIZE bytes owned by the endpoint
+ * @param[in] bool b_private Variable needs authorization
+ */
+    void f_variable(const char* s_name, void (*f_getter)(const char*, char*), bool b_private = false);
+
+/**
+ * Serves pending requests, has to be called from the main loop
+ */
+    void f_process();
+
+/**
+ * Sends event to subscribed senders
+ */
+    static void f_push(const char* s_name, const char* s_data);
+};
+
+#define LAN_PUSH(s_name, s_data) c_lan::f_push(s_name, s_data)
+
+#else
+
+#define LAN_PUSH(s_name, s_data)
+
+#endif
+
+#endif
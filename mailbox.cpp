@@ -0,0 +1,50 @@
+// $Id$
+/**
+ * @file mailbox.cpp
+ * @brief Command handoff from cloud thread to door thread
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "mailbox.h"
+
+int c_mailbox::f_call(mailboxCommand n_command, const char* s_args) {
+    if (strlen(s_args) >= MAILBOX_ARGSIZE)
+        return -1;
+    mailboxEntry a_entry;
+    a_entry.n_command = n_command;
+    a_entry.n_seq = ++n_lastSeq;
+    strcpy(a_entry.s_args, s_args);
+
+    // published before the push so the door thread can claim it, entries
+    // given up on earlier no longer match and are skipped
+    uint32_t n_pending = (uint32_t)a_entry.n_seq << 2 | MAILBOX_PENDING;
+    n_state.store(n_pending, std::memory_order_relaxed);
+    if (!o_commands.f_push(a_entry)) {
+        n_state.store(n_pending | MAILBOX_CANCELLED, std::memory_order_relaxed);
+        return MAILBOX_BUSY;
+    }
+
+    uint32_t n_start = millis();
+    uint32_t n_now;
+    while (((n_now = n_state.load(std::memory_order_acquire)) & MAILBOX_STATEMASK) != MAILBOX_DONE) {
+        if (n_now == n_pending && millis() - n_start > MAILBOX_TIMEOUT
+        && n_state.compare_exchange_strong(n_now, n_pending | MAILBOX_CANCELLED, std::memory_order_relaxed))
+            return MAILBOX_BUSY;
+        // running once claimed, wait for the result however long it takes
+        delay(1);
+    }
+    return n_result.load(std::memory_order_relaxed);
+}
+
+void c_mailbox::f_serve(int (*f_handler)(mailboxCommand, const char*)) {
+    mailboxEntry a_entry;
+    while (o_commands.f_pop(a_entry)) {
+        uint32_t n_pending = (uint32_t)a_entry.n_seq << 2 | MAILBOX_PENDING;
+        if (!n_state.compare_exchange_strong(n_pending, n_pending | MAILBOX_RUNNING, std::memory_order_relaxed))
+            continue;
+        n_result.store(f_handler(a_entry.n_command, a_entry.s_args), std::memory_order_relaxed);
+        n_state.store(n_pending | MAILBOX_DONE, std::memory_order_release);
+    }
+}
@@ -0,0 +1,89 @@
+// $Id$
+/**
+ * @file mailbox.h
+ * @brief Command handoff from cloud thread to door thread
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * With APPTHREAD cloud functions and local network requests are served on
+ * the application thread while doors run on their own thread. Commands are
+ * passed through a lock-free ring and executed by the door thread between
+ * its passes, the calling side waits for the result so function return
+ * values stay the same. Only one caller may wait at a time, which holds as
+ * all requests are served from the application thread.
+ * The command being waited for is tracked in one atomic word holding its
+ * sequence number and state. The door thread claims the command before
+ * running it, a caller that times out cancels it instead, so a command
+ * reported as MAILBOX_BUSY never executes later. If the door thread claimed
+ * it first the caller waits for the result.
+ */
+// $Log$
+
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <atomic>
+#include "application.h"
+#include "global.h"
+#include "ring.h"
+
+// queued commands, power of two
+#define MAILBOX_SIZE 4
+// longest command argument including terminator
+#define MAILBOX_ARGSIZE 128
+// time to wait for the door thread to execute command (mS)
+#define MAILBOX_TIMEOUT 2000
+// result of command which was not executed in time or did not fit
+#define MAILBOX_BUSY -2
+
+// state of the command in the low bits of mailbox state word
+#define MAILBOX_PENDING 0
+#define MAILBOX_RUNNING 1
+#define MAILBOX_CANCELLED 2
+#define MAILBOX_DONE 3
+#define MAILBOX_STATEMASK 0x03
+
+enum mailboxCommand {
+    COMMAND_SETSTATE,
+    COMMAND_SETCONFIG,
+    COMMAND_STATUSSINCE,
+    COMMAND_TELEMETRY
+};
+
+class c_mailbox {
+
+    typedef struct {
+        mailboxCommand n_command;
+        uint16_t n_seq;
+        char s_args[MAILBOX_ARGSIZE];
+    } mailboxEntry;
+
+protected:
+    c_ring<mailboxEntry, MAILBOX_SIZE> o_commands;
+    // result of the last executed command
+    std::atomic<int32_t> n_result;
+    // sequence number of the last command shifted left by two, or'ed with
+    // its MAILBOX_PENDING .. MAILBOX_DONE state
+    std::atomic<uint32_t> n_state;
+    uint16_t n_lastSeq = 0;
+
+public:
+    c_mailbox() : n_result(0), n_state(MAILBOX_DONE) {}
+
+/**
+ * Queues command and waits for the result, calling thread only
+ * @param[in] mailboxCommand n_command Command
+ * @param[in] const char* s_args Argument, shorter than MAILBOX_ARGSIZE
+ * @return command result, -1 if the argument is too long or MAILBOX_BUSY
+ *  if the command was not executed
+ */
+    int f_call(mailboxCommand n_command, const char* s_args);
+
+/**
+ * Executes queued commands, door thread only
+ * @param[in] int (*f_handler)(mailboxCommand, const char*) Executes command
+ */
+    void f_serve(int (*f_handler)(mailboxCommand, const char*));
+};
+
+#endif
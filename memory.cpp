@@ -0,0 +1,148 @@
+// $Id$
+/**
+ * @file memory.cpp
+ * @brief Boot time object placement and RAM budget report
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "memory.h"
+#include "door.h"
+#include "scheduler.h"
+#include "publisher.h"
+#include "lan.h"
+#include "mailbox.h"
+
+// objects are padded to pool alignment
+#define MEMORY_ALIGNED(n_size) (((n_size) + MEMORY_ALIGN - 1) & ~(MEMORY_ALIGN - 1))
+
+// break the build when an object grows past its budget
+static_assert(sizeof(c_door) <= MEMORY_BUDGET_DOOR, "c_door exceeds RAM budget");
+static_assert(sizeof(c_config) <= MEMORY_BUDGET_CONFIG, "c_config exceeds RAM budget");
+static_assert(sizeof(c_sensor) <= MEMORY_BUDGET_SENSOR, "c_sensor exceeds RAM budget");
+static_assert(sizeof(c_timeout) <= MEMORY_BUDGET_TIMEOUT, "c_timeout exceeds RAM budget");
+static_assert(sizeof(c_relay) <= MEMORY_BUDGET_RELAY, "c_relay exceeds RAM budget");
+static_assert(sizeof(c_telemetry) <= MEMORY_BUDGET_TELEMETRY, "c_telemetry exceeds RAM budget");
+static_assert(sizeof(c_scheduler) <= MEMORY_BUDGET_SCHEDULER, "c_scheduler exceeds RAM budget");
+static_assert(sizeof(c_publisher) <= MEMORY_BUDGET_PUBLISHER, "c_publisher exceeds RAM budget");
+static_assert(sizeof(c_travel) <= MEMORY_BUDGET_TRAVEL, "c_travel exceeds RAM budget");
+static_assert(sizeof(c_alerts) <= MEMORY_BUDGET_ALERTS, "c_alerts exceeds RAM budget");
+static_assert(sizeof(c_script) <= MEMORY_BUDGET_SCRIPT, "c_script exceeds RAM budget");
+#if APPLAN
+static_assert(sizeof(c_lan) <= MEMORY_BUDGET_LAN, "c_lan exceeds RAM budget");
+#endif
+#if APPTHREAD
+static_assert(sizeof(c_mailbox) <= MEMORY_BUDGET_MAILBOX, "c_mailbox exceeds RAM budget");
+static_assert(sizeof(c_snapshot<doorSnapshot>) <= MEMORY_BUDGET_SNAPSHOT, "c_snapshot exceeds RAM budget");
+static_assert(sizeof(Thread) <= MEMORY_BUDGET_THREAD, "Thread exceeds RAM budget");
+#endif
+
+// everything created by setup(): shared scheduler, publisher, local
+// network endpoint, mailbox and door thread, then per door object with its
+// snapshot, config, sensor, relay, telemetry, travel estimate, alert rules,
+// script and timeouts
+static_assert(
+    MEMORY_ALIGNED(sizeof(c_scheduler)) + MEMORY_ALIGNED(sizeof(c_publisher)) +
+    (APPLAN ? MEMORY_BUDGET_LAN : 0) +
+    (APPTHREAD ? MEMORY_BUDGET_MAILBOX + MEMORY_BUDGET_THREAD : 0) +
+    DOOR_COUNT * (
+        (APPTHREAD ? MEMORY_BUDGET_SNAPSHOT : 0) +
+        MEMORY_ALIGNED(sizeof(c_door)) +
+        MEMORY_ALIGNED(sizeof(c_config)) +
+        MEMORY_ALIGNED(sizeof(c_sensor)) +
+        MEMORY_ALIGNED(sizeof(c_relay)) +
+        MEMORY_ALIGNED(sizeof(c_telemetry)) +
+        MEMORY_ALIGNED(sizeof(c_travel)) +
+        MEMORY_ALIGNED(sizeof(c_alerts)) +
+        MEMORY_ALIGNED(sizeof(c_script)) +
+        (APPRELAYISR ? 4 : 5) * MEMORY_ALIGNED(sizeof(c_timeout))
+    ) <= MEMORY_POOLSIZE,
+    "MEMORY_POOLSIZE too small for boot time objects"
+);
+
+#if APPSTATIC
+alignas(MEMORY_ALIGN) static uint8_t a_pool[MEMORY_POOLSIZE];
+#endif
+
+c_memory::typeStats c_memory::a_types[MEMORY_MAXTYPES];
+uint8_t c_memory::n_types = 0;
+uint32_t c_memory::n_poolUsed = 0;
+uint32_t c_memory::n_heapUsed = 0;
+uint16_t c_memory::n_late = 0;
+bool c_memory::b_sealed = FALSE;
+uint32_t c_memory::n_heapFree = 0;
+
+void* c_memory::f_allocate(size_t n_size, const char* s_type) {
+    f_record(n_size, s_type);
+    if (b_sealed) {
+        n_late++;
+        #ifdef APPDEBUG
+            Serial.print("Late allocation: ");
+            Serial.println(s_type);
+        #endif
+    }
+
+    #if APPSTATIC
+        size_t n_aligned = MEMORY_ALIGNED(n_size);
+        if (n_poolUsed + n_aligned <= MEMORY_POOLSIZE) {
+            void* p_object = a_pool + n_poolUsed;
+            n_poolUsed += n_aligned;
+            return p_object;
+        }
+        #ifdef APPDEBUG
+            Serial.print("Memory pool exhausted: ");
+            Serial.println(s_type);
+        #endif
+    #endif
+
+    n_heapUsed += n_size;
+    return ::operator new(n_size);
+}
+
+void c_memory::f_record(size_t n_size, const char* s_type) {
+    for (uint8_t n_type = 0; n_type < n_types; n_type++) {
+        if (!strcmp(a_types[n_type].s_type, s_type)) {
+            a_types[n_type].n_count++;
+            return;
+        }
+    }
+    if (n_types == MEMORY_MAXTYPES)
+        return;
+    a_types[n_types].s_type = s_type;
+    a_types[n_types].n_size = n_size;
+    a_types[n_types].n_count = 1;
+    n_types++;
+}
+
+void c_memory::f_seal() {
+    b_sealed = TRUE;
+    n_heapFree = System.freeMemory();
+}
+
+void c_memory::f_print() {
+    #ifdef APPDEBUG
+        uint32_t n_total = 0;
+        Serial.println("RAM report (bytes x count):");
+        for (uint8_t n_type = 0; n_type < n_types; n_type++) {
+            Serial.print(a_types[n_type].s_type);
+            Serial.print(": ");
+            Serial.print(a_types[n_type].n_size);
+            Serial.print(" x ");
+            Serial.println(a_types[n_type].n_count);
+            n_total += a_types[n_type].n_size * a_types[n_type].n_count;
+        }
+        Serial.print("total: ");
+        Serial.println(n_total);
+        #if APPSTATIC
+            Serial.print("pool used: ");
+            Serial.print(n_poolUsed);
+            Serial.print(" of ");
+            Serial.println(MEMORY_POOLSIZE);
+        #endif
+        Serial.print("heap used: ");
+        Serial.println(n_heapUsed);
+        Serial.print("heap free after boot: ");
+        Serial.println(n_heapFree);
+    #endif
+}
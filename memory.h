@@ -0,0 +1,96 @@
+// $Id$
+/**
+ * @file memory.h
+ * @brief Boot time object placement and RAM budget report
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Long lived objects are created with APPNEW() during setup(). With
+ * APPSTATIC enabled they are placed into a statically sized pool so the
+ * heap is not touched by the firmware itself, otherwise they go to heap as
+ * before. Either way every placement is recorded for the RAM report and
+ * allocations after f_seal() are counted as late.
+ */
+// $Log$
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <new>
+#include "application.h"
+#include "global.h"
+
+// RAM budgets (bytes) per object, checked at compile time in memory.cpp
+#define MEMORY_BUDGET_DOOR 1024
+#define MEMORY_BUDGET_CONFIG 64
+#define MEMORY_BUDGET_SENSOR 64
+#define MEMORY_BUDGET_TIMEOUT 32
+#define MEMORY_BUDGET_RELAY 112
+#define MEMORY_BUDGET_TELEMETRY 4224
+#define MEMORY_BUDGET_SCHEDULER 576
+// events raised by the door thread pass through inbox with APPTHREAD
+#define MEMORY_BUDGET_PUBLISHER (APPTHREAD ? 2176 : 1472)
+#define MEMORY_BUDGET_TRAVEL 24
+#define MEMORY_BUDGET_ALERTS 176
+#define MEMORY_BUDGET_SCRIPT 176
+#define MEMORY_BUDGET_LAN 1280
+#define MEMORY_BUDGET_MAILBOX 640
+#define MEMORY_BUDGET_SNAPSHOT 512
+#define MEMORY_BUDGET_THREAD 16
+// static pool for APPSTATIC placement, must fit all boot time objects
+#define MEMORY_POOLSIZE ( \
+    2048 + \
+    (APPLAN ? MEMORY_BUDGET_LAN : 0) + \
+    (APPTHREAD ? 1536 : 0) + \
+    DOOR_COUNT * (5888 + (APPTHREAD ? MEMORY_BUDGET_SNAPSHOT : 0)) \
+)
+
+// placement alignment within the pool
+#define MEMORY_ALIGN 8
+// number of distinct object types tracked by the report
+#define MEMORY_MAXTYPES 16
+
+// creates long lived object, usage: APPNEW(c_class)(constructor arguments)
+#define APPNEW(type) new (c_memory::f_allocate(sizeof(type), #type)) type
+
+class c_memory {
+
+  public:
+/**
+ * Provides storage for an object, from the static pool with APPSTATIC or
+ *  heap otherwise. Pool overflow falls back to heap and shows in the report.
+ * @param[in] size_t n_size Object size
+ * @param[in] const char* s_type Type name for the report
+ * @return pointer to storage
+ */
+    static void* f_allocate(size_t n_size, const char* s_type);
+
+/**
+ * Marks the end of boot, later allocations are counted as late
+ */
+    static void f_seal();
+
+/**
+ * Prints the report to serial console, one object type per line
+ */
+    static void f_print();
+
+  private:
+    typedef struct {
+        const char* s_type;
+        uint16_t n_size;
+        uint8_t n_count;
+    } typeStats;
+
+    static typeStats a_types[MEMORY_MAXTYPES];
+    static uint8_t n_types;
+    static uint32_t n_poolUsed;
+    static uint32_t n_heapUsed;
+    static uint16_t n_late;
+    static bool b_sealed;
+    static uint32_t n_heapFree;
+
+    static void f_record(size_t n_size, const char* s_type);
+};
+
+#endif
@@ -0,0 +1,116 @@
+// $Id$
+/**
+ * @file profiler.cpp
+ * @brief Hot path section profiler
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "profiler.h"
+
+#if APPPROFILE
+
+#ifndef __arm__
+    #include <time.h>
+#endif
+
+c_profiler::sectionStats c_profiler::a_sections[PROFILE_SECTIONS];
+
+const char* const c_profiler::a_names[PROFILE_SECTIONS] = {
+    "loop",
+    "cloud",
+    "sched",
+    "sensor",
+    "state",
+    "status",
+    "net",
+    "stats",
+    "alerts"
+};
+
+void c_profiler::f_init() {
+    #ifdef __arm__
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    #endif
+}
+
+uint32_t c_profiler::f_ticks() {
+    #ifdef __arm__
+        return DWT->CYCCNT;
+    #else
+        struct timespec a_time;
+        clock_gettime(CLOCK_MONOTONIC, &a_time);
+        return a_time.tv_sec * 1000000000UL + a_time.tv_nsec;
+    #endif
+}
+
+uint32_t c_profiler::f_ticksPerMicrosecond() {
+    #ifdef __arm__
+        return SystemCoreClock / 1000000;
+    #else
+        return 1000;
+    #endif
+}
+
+void c_profiler::f_record(profileSection n_section, uint32_t n_ticks) {
+    sectionStats* a_stats = &a_sections[n_section];
+    a_stats->n_count++;
+    a_stats->n_total += n_ticks;
+    if (n_ticks > a_stats->n_max)
+        a_stats->n_max = n_ticks;
+
+    uint8_t n_bucket = 0;
+    while (n_ticks >>= 1)
+        n_bucket++;
+    if (a_stats->a_histogram[n_bucket] < 0xFFFF)
+        a_stats->a_histogram[n_bucket]++;
+}
+
+void c_profiler::f_render(char* s_report) {
+    uint32_t n_perUs = f_ticksPerMicrosecond();
+    int n_length = 0;
+    s_report[0] = 0;
+    for (uint8_t n_section = 0; n_section < PROFILE_SECTIONS; n_section++) {
+        sectionStats* a_stats = &a_sections[n_section];
+        n_length += sprintf(
+            s_report + n_length,
+            "%s%s=%lu,%lu,%lu",
+            n_section ? "|" : "",
+            a_names[n_section],
+            (unsigned long)a_stats->n_count,
+            a_stats->n_count ? (unsigned long)(a_stats->n_total / a_stats->n_count / n_perUs) : 0UL,
+            (unsigned long)(a_stats->n_max / n_perUs)
+        );
+    }
+}
+
+void c_profiler::f_print() {
+    #ifdef APPDEBUG
+        uint32_t n_perUs = f_ticksPerMicrosecond();
+        Serial.println("section count avg(uS) max(uS) histogram(2^n ticks:count)");
+        for (uint8_t n_section = 0; n_section < PROFILE_SECTIONS; n_section++) {
+            sectionStats* a_stats = &a_sections[n_section];
+            Serial.print(a_names[n_section]);
+            Serial.print(" ");
+            Serial.print(a_stats->n_count);
+            Serial.print(" ");
+            Serial.print(a_stats->n_count ? (uint32_t)(a_stats->n_total / a_stats->n_count / n_perUs) : 0);
+            Serial.print(" ");
+            Serial.print(a_stats->n_max / n_perUs);
+            for (uint8_t n_bucket = 0; n_bucket < PROFILE_BUCKETS; n_bucket++) {
+                if (!a_stats->a_histogram[n_bucket])
+                    continue;
+                Serial.print(" ");
+                Serial.print(n_bucket);
+                Serial.print(":");
+                Serial.print(a_stats->a_histogram[n_bucket]);
+            }
+            Serial.println();
+        }
+    #endif
+}
+
+#endif
@@ -0,0 +1,116 @@
+// $Id$
+/**
+ * @file profiler.h
+ * @brief Hot path section profiler
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Sections are timed with DWT cycle counter on STM32 or clock_gettime() on
+ * a host build. Per section count, total, maximum and log2 histogram are
+ * kept in static storage. With APPPROFILE disabled PROFILE() expands to
+ * nothing and the profiler is not compiled.
+ */
+// $Log$
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "application.h"
+#include "global.h"
+
+#if APPPROFILE
+
+// histogram buckets, bucket n counts durations of 2^n to 2^(n+1)-1 ticks
+#define PROFILE_BUCKETS 32
+
+enum profileSection {
+    PROFILE_LOOP,
+    PROFILE_CLOUD,
+    PROFILE_SCHEDULER,
+    PROFILE_SENSOR,
+    PROFILE_STATE,
+    PROFILE_STATUS,
+    PROFILE_NETCONFIG,
+    PROFILE_STATS,
+    PROFILE_ALERTS,
+    PROFILE_SECTIONS
+};
+
+class c_profiler {
+
+    typedef struct {
+        uint32_t n_count;
+        uint64_t n_total;
+        uint32_t n_max;
+        uint16_t a_histogram[PROFILE_BUCKETS];
+    } sectionStats;
+
+protected:
+    static sectionStats a_sections[PROFILE_SECTIONS];
+    static const char* const a_names[PROFILE_SECTIONS];
+
+public:
+
+/**
+ * Enables cycle counter, must be called once before profiling
+ */
+    static void f_init();
+
+/**
+ * Reads current tick count
+ */
+    static uint32_t f_ticks();
+
+/**
+ * Records duration of a section run
+ * @param[in] profileSection n_section Section
+ * @param[in] uint32_t n_ticks Duration in ticks
+ */
+    static void f_record(profileSection n_section, uint32_t n_ticks);
+
+/**
+ * Renders count, average and maximum time (uS) of every section
+ * @param[out] char* s_report Buffer of MAXVARSIZE bytes
+ */
+    static void f_render(char* s_report);
+
+/**
+ * Prints all statistics including histograms to debug serial port
+ */
+    static void f_print();
+
+protected:
+    static uint32_t f_ticksPerMicrosecond();
+};
+
+/**
+ * Times the enclosing scope
+ */
+class c_profileScope {
+
+protected:
+    profileSection n_section;
+    uint32_t n_start;
+
+public:
+    c_profileScope(profileSection n_scopeSection) {
+        n_section = n_scopeSection;
+        n_start = c_profiler::f_ticks();
+    }
+
+    ~c_profileScope() {
+        c_profiler::f_record(n_section, c_profiler::f_ticks() - n_start);
+    }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE(section) c_profileScope PROFILE_CONCAT(o_profileScope, __LINE__)(section)
+
+#else
+
+#define PROFILE(section)
+
+#endif
+
+#endif
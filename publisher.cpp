@@ -0,0 +1,241 @@
+// $Id$
+/**
+ * @file publisher.cpp
+ * @brief Rate limited queue for outbound cloud events
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "publisher.h"
+#include "trace.h"
+#include "lan.h"
+
+c_publisher::c_publisher(c_scheduler *o_publisherScheduler) {
+    o_scheduler = o_publisherScheduler;
+    n_event = o_scheduler ? o_scheduler->f_register(f_onRetry, this) : -1;
+    n_refillTime = millis();
+}
+
+bool c_publisher::f_publish(const char* s_name, const char* s_data, bool b_coalesce) {
+  #if APPTHREAD
+    // door thread, queue belongs to the cloud thread
+    publishEvent a_event;
+    strncpy(a_event.s_name, s_name, PUBLISH_NAMESIZE - 1);
+    a_event.s_name[PUBLISH_NAMESIZE - 1] = 0;
+    strncpy(a_event.s_data, s_data, PUBLISH_DATASIZE - 1);
+    a_event.s_data[PUBLISH_DATASIZE - 1] = 0;
+    a_event.b_coalesce = b_coalesce;
+    return o_inbox.f_push(a_event);
+  #else
+    LAN_PUSH(s_name, s_data);
+    f_checkConnection();
+    bool b_queued = f_queue(s_name, s_data, b_coalesce);
+    f_send();
+    return b_queued;
+  #endif
+}
+
+/**
+ * Moves events raised by the door thread to the queue
+ */
+void c_publisher::f_receive() {
+  #if APPTHREAD
+    publishEvent a_event;
+    while (o_inbox.f_pop(a_event)) {
+        LAN_PUSH(a_event.s_name, a_event.s_data);
+        f_queue(a_event.s_name, a_event.s_data, a_event.b_coalesce);
+    }
+  #endif
+}
+
+/**
+ * Adds event to the queue, while offline the oldest one makes room
+ */
+bool c_publisher::f_queue(const char* s_name, const char* s_data, bool b_coalesce) {
+
+    bool b_offline = n_connState != CONN_CONNECTED;
+    bool b_merged = FALSE;
+
+    // superseded event is removed and the new one appended, so it does not
+    // go out ahead of events queued after the one it replaces
+    if (b_coalesce) {
+        for (uint8_t n_pos = 0; n_pos < n_count; n_pos++) {
+            publishEvent* a_queued = &a_queue[(n_head + n_pos) % PUBLISH_QUEUESIZE];
+            if (a_queued->b_coalesce && !strcmp(a_queued->s_name, s_name)) {
+                for (uint8_t n_next = n_pos + 1; n_next < n_count; n_next++)
+                    a_queue[(n_head + n_next - 1) % PUBLISH_QUEUESIZE] = a_queue[(n_head + n_next) % PUBLISH_QUEUESIZE];
+                n_count--;
+                b_merged = TRUE;
+                n_coalesced++;
+                if (b_offline)
+                    n_outageMerged++;
+                break;
+            }
+        }
+    }
+
+    if (n_count == PUBLISH_QUEUESIZE) {
+        n_dropped++;
+        if (!b_offline) {
+            #ifdef APPDEBUG
+                Serial.print("Event dropped: ");
+                Serial.println(s_name);
+            #endif
+            return FALSE;
+        }
+        // recent events matter more after an outage
+        n_outageDropped++;
+        n_head = (n_head + 1) % PUBLISH_QUEUESIZE;
+        n_count--;
+    }
+    publishEvent* a_event = &a_queue[(n_head + n_count++) % PUBLISH_QUEUESIZE];
+    strncpy(a_event->s_name, s_name, PUBLISH_NAMESIZE - 1);
+    a_event->s_name[PUBLISH_NAMESIZE - 1] = 0;
+    a_event->b_coalesce = b_coalesce;
+    a_event->b_stored = b_offline;
+    if (b_offline && !b_merged)
+        n_outageBuffered++;
+    strncpy(a_event->s_data, s_data, PUBLISH_DATASIZE - 1);
+    a_event->s_data[PUBLISH_DATASIZE - 1] = 0;
+    a_event->n_time = Time.now();
+    return TRUE;
+}
+
+/**
+ * Follows cloud connection, outage is reported once it is over
+ * @return TRUE if connected
+ */
+bool c_publisher::f_checkConnection() {
+    bool b_connected = Particle.connected();
+    if (b_connected == (n_connState == CONN_CONNECTED))
+        return b_connected;
+    TRACE_CONNECTION(b_connected);
+
+    if (!b_connected) {
+        #ifdef APPDEBUG
+            Serial.println("Cloud disconnected, storing events");
+        #endif
+        n_connState = CONN_DISCONNECTED;
+        n_outageStart = millis();
+        n_outageBuffered = 0;
+        n_outageMerged = 0;
+        n_outageDropped = 0;
+        return FALSE;
+    }
+
+    bool b_outage = n_connState == CONN_DISCONNECTED;
+    n_connState = CONN_CONNECTED;
+    if (b_outage) {
+        char s_report[PUBLISH_DATASIZE];
+        snprintf(
+            s_report, sizeof(s_report), "buffered=%u|merged=%u|dropped=%u|time=%lus",
+            n_outageBuffered, n_outageMerged, n_outageDropped,
+            (unsigned long)((millis() - n_outageStart) / 1000)
+        );
+        #ifdef APPDEBUG
+            Serial.print("Cloud connected, outage ");
+            Serial.println(s_report);
+        #endif
+        n_outages++;
+        f_queue("outage", s_report, FALSE);
+    }
+    return TRUE;
+}
+
+/**
+ * Packs stored events from the head of the queue into batch data
+ * @param[out] char* s_batch PUBLISH_BATCHSIZE bytes
+ * @return number of events packed, at least one
+ */
+uint8_t c_publisher::f_pack(char* s_batch) {
+    uint16_t n_length = 0;
+    uint8_t n_packed = 0;
+    while (n_packed < n_count) {
+        publishEvent* a_event = &a_queue[(n_head + n_packed) % PUBLISH_QUEUESIZE];
+        if (!a_event->b_stored)
+            break;
+        int n_entry = snprintf(
+            s_batch + n_length, PUBLISH_BATCHSIZE - n_length, "%s%lu,%s,%s",
+            n_packed ? ";" : "", (unsigned long)a_event->n_time, a_event->s_name, a_event->s_data
+        );
+        if (n_length + n_entry >= PUBLISH_BATCHSIZE) {
+            // the first entry always fits, the one that did not is cut off
+            s_batch[n_length] = 0;
+            break;
+        }
+        n_length += n_entry;
+        n_packed++;
+    }
+    return n_packed;
+}
+
+void c_publisher::f_send() {
+
+    // connection first, events received while offline are stored
+    bool b_connected = f_checkConnection();
+    f_receive();
+    // stored events wait for the connection, f_send() is polled by main loop
+    if (!b_connected)
+        return;
+
+    f_refill();
+    while (n_count && n_tokens) {
+        publishEvent* a_event = &a_queue[n_head];
+        const char* s_name = a_event->s_name;
+        const char* s_data = a_event->s_data;
+        uint8_t n_sent = 1;
+        char s_batch[PUBLISH_BATCHSIZE];
+        if (a_event->b_stored) {
+            n_sent = f_pack(s_batch);
+            s_name = PUBLISH_BATCHEVENT;
+            s_data = s_batch;
+        }
+        if (!Particle.publish(s_name, s_data, PUBLISH_TTL, PRIVATE))
+            break;
+        TRACE_PUBLISH(s_name, s_data);
+        n_head = (n_head + n_sent) % PUBLISH_QUEUESIZE;
+        n_count -= n_sent;
+        n_tokens--;
+        n_published += n_sent;
+    }
+
+    // come back when the next token is earned
+    if (o_scheduler && n_count && !o_scheduler->f_isPending(n_event))
+        o_scheduler->f_schedule(n_event, PUBLISH_INTERVAL - (millis() - n_refillTime) % PUBLISH_INTERVAL);
+}
+
+/**
+ * Adds tokens earned since the last refill
+ */
+void c_publisher::f_refill() {
+    uint32_t n_earned = (millis() - n_refillTime) / PUBLISH_INTERVAL;
+    if (!n_earned)
+        return;
+    n_refillTime += n_earned * PUBLISH_INTERVAL;
+    n_tokens = n_tokens + n_earned > PUBLISH_BURST ? PUBLISH_BURST : n_tokens + n_earned;
+}
+
+void c_publisher::f_onRetry(void* p_publisher) {
+    ((c_publisher*)p_publisher)->f_send();
+}
+
+uint32_t c_publisher::f_getPublished() {
+    return n_published;
+}
+
+uint32_t c_publisher::f_getCoalesced() {
+    return n_coalesced;
+}
+
+uint32_t c_publisher::f_getDropped() {
+  #if APPTHREAD
+    return n_dropped + o_inbox.f_getOverruns();
+  #else
+    return n_dropped;
+  #endif
+}
+
+uint32_t c_publisher::f_getOutages() {
+    return n_outages;
+}
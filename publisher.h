@@ -0,0 +1,134 @@
+// $Id$
+/**
+ * @file publisher.h
+ * @brief Rate limited queue for outbound cloud events
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Particle cloud accepts bursts of up to four events followed by one event
+ * per second, anything above is dropped. Events are queued here and sent
+ * as a token bucket allows.
+ *
+ * While the cloud is not connected events stay in the queue with the time
+ * they were raised, the oldest is dropped when it fills up. Once connected
+ * again stored events are sent in order, packed into as few "batch" events
+ * as fit, entries separated by ';' each "<time>,<name>,<data>" where time
+ * is the epoch of the original event. The outage is then reported by an
+ * "outage" event with the number of events buffered, merged into queued
+ * ones, dropped and the outage duration.
+ *
+ * With APPTHREAD events are raised by the door thread and only passed
+ * through a lock-free inbox, queueing and sending is done by f_send() on
+ * the cloud thread.
+ */
+// $Log$
+
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include "application.h"
+#include "global.h"
+#include "scheduler.h"
+#include "ring.h"
+
+// maximum number of queued events
+#define PUBLISH_QUEUESIZE 16
+// events passed from door thread between cloud loop passes, power of two
+#define PUBLISH_INBOXSIZE 8
+// maximum event name and data lengths including terminator
+#define PUBLISH_NAMESIZE 12
+#define PUBLISH_DATASIZE 64
+// number of events that can be sent back to back
+#define PUBLISH_BURST 4
+// time to earn one more event (mS)
+#define PUBLISH_INTERVAL 1000
+// events time to live (S)
+#define PUBLISH_TTL 60
+// batch event data size including terminator, cloud maximum
+#define PUBLISH_BATCHSIZE 256
+// name of event carrying events stored while offline
+#define PUBLISH_BATCHEVENT "batch"
+
+enum connState {
+    CONN_INITIAL,
+    CONN_DISCONNECTED,
+    CONN_CONNECTED
+};
+
+class c_publisher {
+
+    typedef struct {
+        char s_name[PUBLISH_NAMESIZE];
+        char s_data[PUBLISH_DATASIZE];
+        bool b_coalesce;
+        // raised while offline, sent in batch with its time
+        bool b_stored;
+        uint32_t n_time;
+    } publishEvent;
+
+protected:
+    c_scheduler *o_scheduler;
+    int8_t n_event;
+    publishEvent a_queue[PUBLISH_QUEUESIZE];
+    uint8_t n_head = 0;
+    uint8_t n_count = 0;
+    uint8_t n_tokens = PUBLISH_BURST;
+    uint32_t n_refillTime;
+
+    uint32_t n_published = 0;
+    uint32_t n_coalesced = 0;
+    uint32_t n_dropped = 0;
+
+    // connection tracking and counters of the current outage
+    connState n_connState = CONN_INITIAL;
+    uint32_t n_outageStart = 0;
+    uint16_t n_outageBuffered = 0;
+    uint16_t n_outageMerged = 0;
+    uint16_t n_outageDropped = 0;
+    uint32_t n_outages = 0;
+
+#if APPTHREAD
+    c_ring<publishEvent, PUBLISH_INBOXSIZE> o_inbox;
+#endif
+
+public:
+
+/**
+ * Publisher constructor
+ * @param[in] c_scheduler* o_publisherScheduler Scheduler used to retry
+ *  sending when rate limit is reached, NULL if f_send() is only polled
+ */
+    c_publisher(c_scheduler *o_publisherScheduler);
+
+/**
+ * Queues the event and sends it right away if the rate limit allows
+ * @param[in] const char* s_name Event name
+ * @param[in] const char* s_data Event data, truncated to PUBLISH_DATASIZE
+ * @param[in] bool b_coalesce Replace queued event with the same name, for
+ *  events where only the latest value matters. The new one goes to the end
+ *  of the queue so events keep the order they were raised in
+ * @return FALSE if the queue was full and event was dropped
+ */
+    bool f_publish(const char* s_name, const char* s_data, bool b_coalesce = FALSE);
+
+/**
+ * Sends queued events allowed by the rate limit, has to be called from
+ *  the main loop as well to notice connection changes
+ */
+    void f_send();
+
+    uint32_t f_getPublished();
+    uint32_t f_getCoalesced();
+    uint32_t f_getDropped();
+    uint32_t f_getOutages();
+
+protected:
+    bool f_queue(const char* s_name, const char* s_data, bool b_coalesce);
+    void f_receive();
+    bool f_checkConnection();
+    uint8_t f_pack(char* s_batch);
+    void f_refill();
+    static void f_onRetry(void* p_publisher);
+};
+
+#endif
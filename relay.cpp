@@ -0,0 +1,152 @@
+// $Id$
+/**
+ * @file relay.cpp
+ * @brief Garage door button relay actuation pipeline
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "relay.h"
+#include "memory.h"
+
+#if APPRELAYISR
+c_relay* c_relay::a_isrRelays[RELAY_MAXISR];
+uint8_t c_relay::n_isrRelays = 0;
+#endif
+
+c_relay::c_relay(uint8_t n_relayPin, c_scheduler *o_scheduler, uint16_t *p_time, uint16_t *p_pause) {
+    n_pin = n_relayPin;
+    p_relayTime = p_time;
+    p_relayPause = p_pause;
+    pinMode(n_pin, OUTPUT);
+    digitalWrite(n_pin, LOW);
+    #if APPRELAYISR
+        static void (* const a_handlers[RELAY_MAXISR])() = {
+            f_isrHandle<0>,
+            f_isrHandle<1>
+        };
+        a_isrRelays[n_isrRelays] = this;
+        f_isrHandler = a_handlers[n_isrRelays++];
+    #else
+        o_edgeTimeout = APPNEW(c_timeout)(o_scheduler, f_onEdgeTimeout, this);
+    #endif
+}
+
+bool c_relay::f_command(uint8_t n_clicks) {
+    relayCommand a_command;
+    a_command.n_clicks = n_clicks;
+    a_command.n_received = micros();
+    if (!n_clicks)
+        return TRUE;
+    if (!o_commands.f_push(a_command)) {
+        n_dropped++;
+        return FALSE;
+    }
+    f_process();
+    return TRUE;
+}
+
+/**
+ * Sequence is started from main loop when relay is idle, from then on edges
+ *  are driven by the timer until the queue is empty. Checking here also
+ *  picks up command queued while the timer was finishing the last sequence.
+ */
+void c_relay::f_process() {
+    if (n_relayState != RELAY_IDLE || !o_commands.f_count())
+        return;
+    n_relayState = RELAY_PAUSED;
+    f_arm(f_step());
+}
+
+bool c_relay::f_isBusy() {
+    return n_relayState != RELAY_IDLE || o_commands.f_count();
+}
+
+/**
+ * Drives the next relay edge
+ * @return Time until following edge (mS) or zero when sequence is done
+ */
+uint16_t c_relay::f_step() {
+
+    if (n_relayState == RELAY_PRESSED) {
+        digitalWriteFast(n_pin, LOW);
+        // pause also separates consecutive commands
+        if (--n_clicksLeft || o_commands.f_count()) {
+            n_relayState = RELAY_PAUSED;
+            return *p_relayPause;
+        }
+        n_relayState = RELAY_IDLE;
+        return 0;
+    }
+
+    if (!n_clicksLeft) {
+        relayCommand a_command;
+        if (!o_commands.f_pop(a_command)) {
+            n_relayState = RELAY_IDLE;
+            return 0;
+        }
+        n_clicksLeft = a_command.n_clicks;
+        digitalWriteFast(n_pin, HIGH);
+        n_lastPress = millis();
+        n_lastLatency = micros() - a_command.n_received;
+        if (n_lastLatency > n_maxLatency)
+            n_maxLatency = n_lastLatency;
+    }
+    else {
+        digitalWriteFast(n_pin, HIGH);
+        n_lastPress = millis();
+    }
+    n_relayState = RELAY_PRESSED;
+    return *p_relayTime;
+}
+
+/**
+ * Arms one-shot timer for the next edge
+ */
+void c_relay::f_arm(uint16_t n_delay) {
+    #if APPRELAYISR
+        // timer period is set in half milliseconds
+        if (n_delay)
+            o_timer.begin(f_isrHandler, n_delay * 2, hmSec);
+    #else
+        if (n_delay) {
+            o_edgeTimeout->f_setDuration(n_delay);
+            o_edgeTimeout->f_start();
+        }
+    #endif
+}
+
+#if APPRELAYISR
+/**
+ * Timer interrupt handler, period is changed for the next edge or timer is
+ *  stopped when the sequence is done
+ */
+void c_relay::f_isrEdge() {
+    uint16_t n_delay = f_step();
+    if (n_delay)
+        o_timer.resetPeriod_SIT(n_delay * 2, hmSec);
+    else
+        o_timer.end();
+}
+#else
+void c_relay::f_onEdgeTimeout(void* p_relay) {
+    ((c_relay*)p_relay)->f_arm(((c_relay*)p_relay)->f_step());
+}
+#endif
+
+uint32_t c_relay::f_getLastPress() {
+    return n_lastPress;
+}
+
+uint32_t c_relay::f_getLastLatency() {
+    return n_lastLatency;
+}
+
+uint32_t c_relay::f_getMaxLatency() {
+    return n_maxLatency;
+}
+
+uint32_t c_relay::f_getDropped() {
+    return n_dropped;
+}
@@ -0,0 +1,125 @@
+// $Id$
+/**
+ * @file relay.h
+ * @brief Garage door button relay actuation pipeline
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Commands are queued as click sequences and executed one after another
+ * with a pause between all clicks. Relay edges are driven by one-shot
+ * hardware timer when APPRELAYISR is set, otherwise by the scheduler.
+ */
+// $Log$
+
+#ifndef RELAY_H
+#define RELAY_H
+
+#include "application.h"
+#include "global.h"
+#include "ring.h"
+#include "timeout.h"
+
+#if APPRELAYISR
+    #include "SparkIntervalTimer.h"
+#endif
+
+// number of click sequences that can wait for execution
+#define RELAY_QUEUESIZE 4
+// number of relays that can be driven by hardware timers
+#define RELAY_MAXISR 2
+
+#if APPRELAYISR && DOOR_COUNT > RELAY_MAXISR
+    #error "Hardware timer relay mode supports up to RELAY_MAXISR doors"
+#endif
+
+class c_relay {
+
+    enum relayState {
+        RELAY_IDLE,
+        RELAY_PRESSED,
+        RELAY_PAUSED
+    };
+
+    typedef struct {
+        uint8_t n_clicks;
+        uint32_t n_received;
+    } relayCommand;
+
+protected:
+    uint8_t n_pin;
+    uint16_t *p_relayTime;
+    uint16_t *p_relayPause;
+    c_ring<relayCommand, RELAY_QUEUESIZE> o_commands;
+    volatile relayState n_relayState = RELAY_IDLE;
+    volatile uint8_t n_clicksLeft = 0;
+
+    // command received to first edge latency (uS)
+    volatile uint32_t n_lastLatency = 0;
+    volatile uint32_t n_maxLatency = 0;
+    uint32_t n_dropped = 0;
+    // start of the last button press (mS)
+    volatile uint32_t n_lastPress = 0;
+
+#if APPRELAYISR
+    // timer interrupts have no context so each relay gets own handler
+    IntervalTimer o_timer;
+    void (*f_isrHandler)();
+    static c_relay* a_isrRelays[RELAY_MAXISR];
+    static uint8_t n_isrRelays;
+#else
+    c_timeout *o_edgeTimeout;
+#endif
+
+public:
+
+/**
+ * Relay constructor
+ * @param[in] uint8_t n_relayPin Relay pin
+ * @param[in] c_scheduler* o_scheduler Scheduler driving the edges when
+ *  hardware timer is not used
+ * @param[in] uint16_t* p_time Pointer to button press duration (mS)
+ * @param[in] uint16_t* p_pause Pointer to pause between clicks (mS)
+ */
+    c_relay(uint8_t n_relayPin, c_scheduler *o_scheduler, uint16_t *p_time, uint16_t *p_pause);
+
+/**
+ * Queues click sequence
+ * @param[in] uint8_t n_clicks Number of button clicks
+ * @return FALSE if the queue was full and command was dropped
+ */
+    bool f_command(uint8_t n_clicks);
+
+/**
+ * Starts queued commands, has to be called periodically from main loop
+ */
+    void f_process();
+
+/**
+ * Reports if click sequence is running or queued
+ */
+    bool f_isBusy();
+
+/**
+ * Reports when the last button press started, door motion starts with it
+ * @return millis() of the press
+ */
+    uint32_t f_getLastPress();
+
+    uint32_t f_getLastLatency();
+    uint32_t f_getMaxLatency();
+    uint32_t f_getDropped();
+
+protected:
+    uint16_t f_step();
+    void f_arm(uint16_t n_delay);
+#if APPRELAYISR
+    void f_isrEdge();
+    template <uint8_t N> static void f_isrHandle() {
+        a_isrRelays[N]->f_isrEdge();
+    }
+#else
+    static void f_onEdgeTimeout(void* p_relay);
+#endif
+};
+
+#endif
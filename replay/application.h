@@ -0,0 +1,178 @@
+// $Id$
+/**
+ * @file application.h
+ * @brief Particle platform stand-in for the replay engine
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Provides the subset of the Particle API used by the firmware on a Linux
+ * host. Clock, sensor inputs, cloud functions and publishing are driven by
+ * the replay engine in replay.cpp instead of hardware. UDP uses host
+ * sockets so the local network endpoint can be reached over loopback.
+ */
+// $Log$
+
+#ifndef APPLICATION_H
+#define APPLICATION_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define TRUE 1
+#define FALSE 0
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+enum {
+    D0, D1, D2, D3, D4, D5, D6, D7,
+    A0 = 10, A1, A2, A3, A4, A5, A6, A7
+};
+
+// variable types
+enum { INT = 1, DOUBLE = 2, STRING = 4 };
+enum PublishFlag { PUBLIC, PRIVATE };
+
+#define PRODUCT_ID(n_id)
+#define PRODUCT_VERSION(n_version)
+#define SYSTEM_MODE(n_mode)
+#define SYSTEM_THREAD(n_state)
+#define OS_THREAD_PRIORITY_DEFAULT 2
+
+class String {
+    std::string s_value;
+  public:
+    String() {}
+    String(const char* s_init) : s_value(s_init) {}
+    const char* c_str() const { return s_value.c_str(); }
+    unsigned length() const { return s_value.length(); }
+};
+
+// virtual clock
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t n_ms);
+void delayMicroseconds(uint32_t n_us);
+void __WFI();
+
+// hardware random number generator, host random device
+uint32_t HAL_RNG_GetRandomNumber();
+
+// pins, photo sensor inputs come from the trace
+void pinMode(uint16_t n_pin, uint8_t n_mode);
+void digitalWrite(uint16_t n_pin, uint8_t n_value);
+void digitalWriteFast(uint16_t n_pin, uint8_t n_value);
+int32_t digitalRead(uint16_t n_pin);
+int32_t analogRead(uint16_t n_pin);
+
+class SerialC {
+    void f_write(const char* s_text);
+  public:
+    void begin(uint32_t n_baud) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    void print(const char* s_text) { f_write(s_text); }
+    void print(char* s_text) { f_write(s_text); }
+    void print(const String& s_text) { f_write(s_text.c_str()); }
+    void print(char n_char) { char s_text[2] = {n_char, 0}; f_write(s_text); }
+    void print(float n_value) { f_write(std::to_string(n_value).c_str()); }
+    void print(double n_value) { f_write(std::to_string(n_value).c_str()); }
+    template <typename T> void print(T n_value) { f_write(std::to_string(+n_value).c_str()); }
+    void println() { f_write("\n"); }
+    template <typename T> void println(T n_value) { print(n_value); println(); }
+};
+extern SerialC Serial;
+
+class CloudClass {
+  public:
+    bool variable(const char* s_name, const char* s_value, int n_type);
+    bool variable(const char* s_name, char* s_value, int n_type) { return variable(s_name, (const char*)s_value, n_type); }
+    bool variable(const char* s_name, const char* (*f_getter)());
+    bool function(const char* s_name, int (*f_handler)(String));
+    bool publish(const char* s_name, const char* s_data, int n_ttl, PublishFlag n_flag);
+    bool connected();
+    void process();
+};
+extern CloudClass Particle;
+
+class TimeClass {
+    float n_zone = 0;
+    uint32_t f_local();
+  public:
+    uint32_t now();
+    int hour() { return f_local() % 86400 / 3600; }
+    int minute() { return f_local() % 3600 / 60; }
+    int second() { return f_local() % 60; }
+    void zone(float n_offset) { n_zone = n_offset; }
+};
+extern TimeClass Time;
+
+class IPAddress {
+    uint8_t a_octets[4];
+  public:
+    IPAddress(uint8_t n_1 = 0, uint8_t n_2 = 0, uint8_t n_3 = 0, uint8_t n_4 = 0) : a_octets{n_1, n_2, n_3, n_4} {}
+    uint8_t operator[](int n_index) const { return a_octets[n_index]; }
+    bool operator==(const IPAddress& a_other) const { return !memcmp(a_octets, a_other.a_octets, 4); }
+};
+
+class UDP {
+    int n_socket = -1;
+    IPAddress a_remoteIp;
+    uint16_t n_remotePort = 0;
+  public:
+    bool setBuffer(size_t n_size, uint8_t* a_buffer = NULL) { return true; }
+    uint8_t begin(uint16_t n_port);
+    void stop();
+    int receivePacket(uint8_t* a_buffer, size_t n_size, uint32_t n_timeout = 0);
+    int sendPacket(const uint8_t* a_buffer, size_t n_size, IPAddress a_ip, uint16_t n_port);
+    IPAddress remoteIP() { return a_remoteIp; }
+    uint16_t remotePort() { return n_remotePort; }
+};
+
+class WiFiClass {
+  public:
+    bool ready() { return true; }
+    IPAddress localIP() { return IPAddress(192, 168, 1, 100); }
+    IPAddress subnetMask() { return IPAddress(255, 255, 255, 0); }
+    IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+    void macAddress(byte* a_mac) { memset(a_mac, 0, 6); }
+    const char* SSID() { return "replay"; }
+    int RSSI() { return -50; }
+};
+extern WiFiClass WiFi;
+
+// emulated EEPROM size of the Photon
+#define EEPROM_SIZE 2047
+
+class EEPROMClass {
+    uint8_t a_data[EEPROM_SIZE];
+  public:
+    EEPROMClass() { memset(a_data, 0xFF, sizeof(a_data)); }
+    uint8_t read(int n_address) { return a_data[n_address]; }
+    void write(int n_address, uint8_t n_value) { a_data[n_address] = n_value; }
+    size_t length() { return EEPROM_SIZE; }
+};
+extern EEPROMClass EEPROM;
+
+class SystemClass {
+  public:
+    uint32_t freeMemory() { return 60000; }
+};
+extern SystemClass System;
+
+// runs on std::thread, priority is not applied on the host
+class Thread {
+  public:
+    Thread(const char* s_name, void (*f_function)(void*), void* p_param, uint8_t n_priority);
+};
+
+#endif
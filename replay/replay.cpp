@@ -0,0 +1,476 @@
+// $Id$
+/**
+ * @file replay.cpp
+ * @brief Replays a field trace through the firmware on a Linux host
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * The firmware sources are compiled unmodified against the platform
+ * stand-in in this directory and driven from a trace dumped by the
+ * recorder (see trace.h) under a virtual clock:
+ *  - configuration records are saved to emulated EEPROM before setup()
+ *  - photo sensor reads return the recorded sample pairs in order
+ *  - cloud commands are delivered from Particle.process() once due
+ *  - wall clock follows the time records
+ *  - cloud connection follows the connection records, publishing fails
+ *    while disconnected
+ * The clock only moves between loop passes and while idling, so hours of
+ * field time replay in seconds. Builds with APPTHREAD run the door thread
+ * on std::thread and always replay against real time. Every published event is compared to the
+ * recorded sequence; the exit code is non-zero on any difference, so
+ * traces can be kept as regression tests. Timing of the run is reported
+ * as a performance baseline, with APPPROFILE the section profile too.
+ *
+ * Build from the repository root, sensor and relay interrupt modes have to
+ * be disabled (traces recorded with them replay the same in polled mode):
+ *  g++ -std=gnu++11 -O2 -I replay -I . replay/replay.cpp *.cpp -o garagio-replay
+ * Usage:
+ *  garagio-replay [-v] [-l] trace.txt
+ * With -l the clock is real time since setup(), so a build with APPLAN
+ * can be exercised over loopback while the trace plays, e.g.
+ *  echo "doorStatus" | nc -u -w1 127.0.0.1 5566
+ */
+// $Log$
+
+// host only, skipped when the directory is picked up by a device build
+#ifndef PLATFORM_ID
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <random>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "application.h"
+#include "global.h"
+#include "config.h"
+#include "profiler.h"
+
+#if APPSENSORISR || APPRELAYISR
+    #error "replay requires APPSENSORISR and APPRELAYISR disabled"
+#endif
+
+// virtual time of setup(), trace time starts here (uS)
+#define REPLAY_BOOTTIME 1000000ULL
+// virtual time taken by one pass of the main loop (uS)
+#define REPLAY_LOOPTIME 50
+// time replayed past the last record for events in flight (uS)
+#define REPLAY_TAIL 100000ULL
+
+void setup();
+void loop();
+
+struct traceEvent {
+    uint64_t n_time;
+    std::string s_name;
+    std::string s_data;
+};
+
+struct traceSample {
+    uint16_t n_ambient;
+    uint16_t n_lit;
+};
+
+struct pinInput {
+    std::deque<traceSample> a_samples;
+    bool b_lit = false;
+    uint16_t n_last = 0;
+};
+
+static bool b_verbose = false;
+static bool b_live = false;
+static uint64_t n_clock = REPLAY_BOOTTIME;
+static std::chrono::steady_clock::time_point a_start;
+// trace cursors are shared by door and cloud threads with APPTHREAD
+static std::mutex o_lock;
+static uint64_t n_end = 0;
+
+static std::vector<traceEvent> a_commands;
+static std::vector<traceEvent> a_expected;
+static std::vector<std::pair<uint64_t, uint32_t> > a_times;
+static std::vector<std::pair<uint64_t, bool> > a_connections;
+static std::vector<std::pair<uint8_t, std::string> > a_configs;
+static std::map<uint16_t, pinInput> a_inputs;
+static std::map<std::string, int (*)(String)> a_functions;
+
+static size_t n_nextCommand = 0;
+static size_t n_nextTime = 0;
+static size_t n_nextConnection = 0;
+static size_t n_published = 0;
+static size_t n_mismatched = 0;
+static size_t n_unchecked = 0;
+static uint64_t n_maxSkew = 0;
+static uint32_t n_underruns = 0;
+static uint64_t n_loops = 0;
+
+SerialC Serial;
+CloudClass Particle;
+TimeClass Time;
+WiFiClass WiFi;
+EEPROMClass EEPROM;
+SystemClass System;
+
+/**
+ * Current time (uS), virtual or real time since setup() in live mode
+ */
+static uint64_t f_clock() {
+    if (!b_live)
+        return n_clock;
+    return REPLAY_BOOTTIME + std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - a_start).count();
+}
+
+/**
+ * Moves virtual clock forward, waits in live mode
+ */
+static void f_advance(uint64_t n_us) {
+    if (b_live)
+        usleep(n_us);
+    else
+        n_clock += n_us;
+}
+
+uint32_t millis() {
+    return f_clock() / 1000;
+}
+
+uint32_t micros() {
+    return f_clock();
+}
+
+void delay(uint32_t n_ms) {
+    f_advance(n_ms * 1000ULL);
+}
+
+void delayMicroseconds(uint32_t n_us) {
+    f_advance(n_us);
+}
+
+uint32_t HAL_RNG_GetRandomNumber() {
+    static std::random_device o_random;
+    return o_random();
+}
+
+/**
+ * Idle wait ends with the next millisecond tick
+ */
+void __WFI() {
+    f_advance(1000 - f_clock() % 1000);
+}
+
+void pinMode(uint16_t n_pin, uint8_t n_mode) {}
+void digitalWrite(uint16_t n_pin, uint8_t n_value) {}
+void digitalWriteFast(uint16_t n_pin, uint8_t n_value) {}
+
+int32_t digitalRead(uint16_t n_pin) {
+    return LOW;
+}
+
+/**
+ * Returns ambient and lit values of recorded sample pairs in turn, the last
+ *  value is repeated once the pin runs out of samples
+ */
+int32_t analogRead(uint16_t n_pin) {
+    std::lock_guard<std::mutex> o_guard(o_lock);
+    pinInput& a_input = a_inputs[n_pin];
+    if (a_input.a_samples.empty()) {
+        n_underruns++;
+        return a_input.n_last;
+    }
+    traceSample& a_sample = a_input.a_samples.front();
+    a_input.n_last = a_input.b_lit ? a_sample.n_lit : a_sample.n_ambient;
+    if (a_input.b_lit)
+        a_input.a_samples.pop_front();
+    a_input.b_lit = !a_input.b_lit;
+    return a_input.n_last;
+}
+
+void SerialC::f_write(const char* s_text) {
+    if (b_verbose)
+        fputs(s_text, stderr);
+}
+
+bool CloudClass::variable(const char* s_name, const char* s_value, int n_type) {
+    return true;
+}
+
+bool CloudClass::variable(const char* s_name, const char* (*f_getter)()) {
+    return true;
+}
+
+bool CloudClass::function(const char* s_name, int (*f_handler)(String)) {
+    a_functions[s_name] = f_handler;
+    return true;
+}
+
+/**
+ * Connection follows the latest connection record which is due, connected
+ *  until the first one
+ */
+bool CloudClass::connected() {
+    std::lock_guard<std::mutex> o_guard(o_lock);
+    while (n_nextConnection < a_connections.size() &&
+           a_connections[n_nextConnection].first + REPLAY_BOOTTIME <= f_clock())
+        n_nextConnection++;
+    return n_nextConnection ? a_connections[n_nextConnection - 1].second : true;
+}
+
+/**
+ * Compares published event to the next recorded one
+ */
+bool CloudClass::publish(const char* s_name, const char* s_data, int n_ttl, PublishFlag n_flag) {
+    if (!connected())
+        return false;
+    uint64_t n_time = f_clock() - REPLAY_BOOTTIME;
+    if (b_verbose)
+        fprintf(stderr, "[%.6f] publish %s \"%s\"\n", n_time / 1e6, s_name, s_data);
+    if (n_published >= a_expected.size()) {
+        // recording ended, nothing to compare with
+        n_unchecked++;
+        return true;
+    }
+
+    const traceEvent& a_event = a_expected[n_published++];
+    if (a_event.s_name != s_name || a_event.s_data != s_data) {
+        n_mismatched++;
+        fprintf(
+            stderr, "MISMATCH #%zu at %.6f: published %s \"%s\", recorded %s \"%s\" at %.6f\n",
+            n_published, n_time / 1e6, s_name, s_data,
+            a_event.s_name.c_str(), a_event.s_data.c_str(), a_event.n_time / 1e6
+        );
+        return true;
+    }
+
+    uint64_t n_skew = n_time > a_event.n_time ? n_time - a_event.n_time : a_event.n_time - n_time;
+    if (n_skew > n_maxSkew)
+        n_maxSkew = n_skew;
+    return true;
+}
+
+/**
+ * Delivers commands which are due to registered cloud functions, called by
+ *  the cloud side only
+ */
+void CloudClass::process() {
+    while (n_nextCommand < a_commands.size() &&
+           a_commands[n_nextCommand].n_time + REPLAY_BOOTTIME <= f_clock()) {
+        const traceEvent& a_command = a_commands[n_nextCommand++];
+        if (!a_functions.count(a_command.s_name)) {
+            fprintf(stderr, "Unknown function %s\n", a_command.s_name.c_str());
+            continue;
+        }
+        int n_result = a_functions[a_command.s_name](String(a_command.s_data.c_str()));
+        if (b_verbose)
+            fprintf(
+                stderr, "[%.6f] %s(\"%s\") = %d\n", (f_clock() - REPLAY_BOOTTIME) / 1e6,
+                a_command.s_name.c_str(), a_command.s_data.c_str(), n_result
+            );
+    }
+}
+
+uint8_t UDP::begin(uint16_t n_port) {
+    stop();
+    n_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in a_address = {};
+    a_address.sin_family = AF_INET;
+    a_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a_address.sin_port = htons(n_port);
+    if (n_socket < 0 || bind(n_socket, (sockaddr*)&a_address, sizeof(a_address)) < 0) {
+        fprintf(stderr, "Can't bind UDP port %u\n", n_port);
+        stop();
+        return 0;
+    }
+    fcntl(n_socket, F_SETFL, O_NONBLOCK);
+    return 1;
+}
+
+void UDP::stop() {
+    if (n_socket >= 0)
+        close(n_socket);
+    n_socket = -1;
+}
+
+/**
+ * Returns 0 when nothing is pending like the device does
+ */
+int UDP::receivePacket(uint8_t* a_buffer, size_t n_size, uint32_t n_timeout) {
+    if (n_socket < 0)
+        return -1;
+    sockaddr_in a_address;
+    socklen_t n_length = sizeof(a_address);
+    ssize_t n_read = recvfrom(n_socket, a_buffer, n_size, 0, (sockaddr*)&a_address, &n_length);
+    if (n_read < 0)
+        return 0;
+    uint32_t n_ip = ntohl(a_address.sin_addr.s_addr);
+    a_remoteIp = IPAddress(n_ip >> 24, n_ip >> 16, n_ip >> 8, n_ip);
+    n_remotePort = ntohs(a_address.sin_port);
+    return n_read;
+}
+
+int UDP::sendPacket(const uint8_t* a_buffer, size_t n_size, IPAddress a_ip, uint16_t n_port) {
+    if (n_socket < 0)
+        return -1;
+    sockaddr_in a_address = {};
+    a_address.sin_family = AF_INET;
+    a_address.sin_addr.s_addr = htonl((uint32_t)a_ip[0] << 24 | a_ip[1] << 16 | a_ip[2] << 8 | a_ip[3]);
+    a_address.sin_port = htons(n_port);
+    return sendto(n_socket, a_buffer, n_size, 0, (sockaddr*)&a_address, sizeof(a_address));
+}
+
+/**
+ * Wall clock follows the latest time record which is due
+ */
+uint32_t TimeClass::now() {
+    std::lock_guard<std::mutex> o_guard(o_lock);
+    uint64_t n_now = f_clock();
+    while (n_nextTime + 1 < a_times.size() && a_times[n_nextTime + 1].first + REPLAY_BOOTTIME <= n_now)
+        n_nextTime++;
+    if (a_times.empty())
+        return n_now / 1000000;
+    uint64_t n_base = a_times[n_nextTime].first + REPLAY_BOOTTIME;
+    return a_times[n_nextTime].second + (n_now > n_base ? (n_now - n_base) / 1000000 : 0);
+}
+
+Thread::Thread(const char* s_name, void (*f_function)(void*), void* p_param, uint8_t n_priority) {
+    std::thread(f_function, p_param).detach();
+}
+
+uint32_t TimeClass::f_local() {
+    return now() + (int32_t)(n_zone * 3600);
+}
+
+/**
+ * Reads trace dump, lines which are not records (other console output
+ *  captured with the dump) are skipped
+ */
+static bool f_loadTrace(const char* s_file) {
+    FILE* p_file = fopen(s_file, "r");
+    if (!p_file)
+        return false;
+
+    char s_line[1024];
+    while (fgets(s_line, sizeof(s_line), p_file)) {
+        s_line[strcspn(s_line, "\r\n")] = 0;
+        char n_type;
+        unsigned long n_seconds, n_micros;
+        int n_offset = 0;
+        if (sscanf(s_line, "%c %lu.%lu %n", &n_type, &n_seconds, &n_micros, &n_offset) != 3 ||
+            s_line[1] != ' ' || !n_offset)
+            continue;
+        uint64_t n_time = n_seconds * 1000000ULL + n_micros;
+        const char* s_payload = s_line + n_offset;
+        if (n_time > n_end)
+            n_end = n_time;
+
+        switch (n_type) {
+            case 'T':
+                a_times.push_back(std::make_pair(n_time, (uint32_t)strtoul(s_payload, NULL, 10)));
+                break;
+            case 'S': {
+                unsigned n_pin, n_ambient, n_lit;
+                if (sscanf(s_payload, "%u %u %u", &n_pin, &n_ambient, &n_lit) == 3)
+                    a_inputs[n_pin].a_samples.push_back(traceSample{(uint16_t)n_ambient, (uint16_t)n_lit});
+                break;
+            }
+            case 'N':
+                a_connections.push_back(std::make_pair(n_time, atoi(s_payload) != 0));
+                break;
+            case 'K':
+                a_configs.push_back(std::make_pair((uint8_t)atoi(s_payload), std::string(strchr(s_payload, ' ') ? strchr(s_payload, ' ') + 1 : "")));
+                break;
+            case 'C':
+            case 'P': {
+                // name ends at the first space, data is the rest of the line
+                const char* s_data = strchr(s_payload, ' ');
+                traceEvent a_event;
+                a_event.n_time = n_time;
+                a_event.s_name = s_data ? std::string(s_payload, s_data - s_payload) : s_payload;
+                a_event.s_data = s_data ? s_data + 1 : "";
+                (n_type == 'C' ? a_commands : a_expected).push_back(a_event);
+                break;
+            }
+        }
+    }
+    fclose(p_file);
+    return true;
+}
+
+int main(int n_argc, char** a_argv) {
+    const char* s_file = NULL;
+    for (int n_arg = 1; n_arg < n_argc; n_arg++) {
+        if (!strcmp(a_argv[n_arg], "-v"))
+            b_verbose = true;
+        else if (!strcmp(a_argv[n_arg], "-l"))
+            b_live = true;
+        else
+            s_file = a_argv[n_arg];
+    }
+    if (!s_file) {
+        fprintf(stderr, "usage: %s [-v] [-l] trace.txt\n", a_argv[0]);
+        return 2;
+    }
+    if (!f_loadTrace(s_file)) {
+        fprintf(stderr, "Can't read %s\n", s_file);
+        return 2;
+    }
+    // door thread can not be stepped by the virtual clock
+    #if APPTHREAD
+        b_live = true;
+    #endif
+
+    // field configuration goes to EEPROM where setup() loads it from
+    for (size_t n_config = 0; n_config < a_configs.size(); n_config++) {
+        if (a_configs[n_config].first >= DOOR_COUNT)
+            continue;
+        c_config o_config(a_configs[n_config].first);
+        o_config.f_set(a_configs[n_config].second.c_str());
+    }
+
+    a_start = std::chrono::steady_clock::now();
+    setup();
+    uint64_t n_stop = REPLAY_BOOTTIME + n_end + REPLAY_TAIL;
+    while (f_clock() < n_stop) {
+        loop();
+        f_advance(REPLAY_LOOPTIME);
+        n_loops++;
+    }
+    double n_wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - a_start).count();
+    double n_virtual = (f_clock() - REPLAY_BOOTTIME) / 1e6;
+
+    size_t n_missing = a_expected.size() > n_published ? a_expected.size() - n_published : 0;
+    printf(
+        "events: %zu recorded, %zu matched, %zu mismatched, %zu missing, %zu past the trace\n",
+        a_expected.size(), n_published - n_mismatched, n_mismatched, n_missing, n_unchecked
+    );
+    printf("commands: %zu of %zu delivered\n", n_nextCommand, a_commands.size());
+    printf("timing skew: max %.3f S\n", n_maxSkew / 1e6);
+    if (n_underruns)
+        printf("sensor underruns: %u\n", n_underruns);
+    printf(
+        "replayed %.1f S in %.3f S (%.0fx), %llu loops, %.0f nS/loop\n",
+        n_virtual, n_wall, n_wall > 0 ? n_virtual / n_wall : 0,
+        (unsigned long long)n_loops, n_loops ? n_wall * 1e9 / n_loops : 0
+    );
+    #if APPPROFILE
+        bool b_echo = b_verbose;
+        b_verbose = true;
+        c_profiler::f_print();
+        b_verbose = b_echo;
+    #endif
+
+    int n_exit = n_mismatched || n_missing ? 1 : 0;
+    // door thread is still running, static objects are left in place
+    #if APPTHREAD
+        fflush(stdout);
+        _exit(n_exit);
+    #endif
+    return n_exit;
+}
+
+#endif
@@ -0,0 +1,64 @@
+// $Id$
+/**
+ * @file scripttest.cpp
+ * @brief Host test of the setState script parser
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Parses scripts which have to be accepted or refused as a whole, in
+ * particular publish steps that could pass for firmware events of this or
+ * another door. Build from the repository root and run, the exit code is
+ * non-zero on any failure:
+ *  g++ -std=gnu++11 -O2 -I replay -I . replay/scripttest.cpp script.cpp -o garagio-scripttest
+ */
+// $Log$
+
+// host only, skipped when the directory is picked up by a device build
+#ifndef PLATFORM_ID
+
+#include "application.h"
+#include "script.h"
+
+typedef struct {
+    const char* s_script;
+    bool b_valid;
+} testScript;
+
+static const testScript a_scripts[] = {
+    {"open; await open 15000; publish", true},
+    {"close; wait 500; publish closing", true},
+    {"publish abcdefghij", true},
+    {"publish abcdefghijk", false},
+    {"publish state", false},
+    {"publish state2", false},
+    {"publish states", false},
+    {"publish timeout3", false},
+    {"publish config2", false},
+    {"publish night", false},
+    {"publish outage", false},
+    {"publish batch1", false},
+    {"publish stat", true},
+    {"open; publish mystate", true},
+    {"wait 600001", false},
+    {"open close", false},
+    {"", false}
+};
+
+static bool f_isState(const char* s_state) {
+    return !strcmp(s_state, "open") || !strcmp(s_state, "close") || !strcmp(s_state, "closed");
+}
+
+int main(int argc, char** argv) {
+    c_script o_script;
+    bool b_passed = true;
+    for (uint8_t n_script = 0; n_script < sizeof(a_scripts) / sizeof(a_scripts[0]); n_script++) {
+        const testScript* a_test = &a_scripts[n_script];
+        bool b_valid = o_script.f_load(a_test->s_script, f_isState) >= 0;
+        printf("%-40s %s\n", a_test->s_script, b_valid == a_test->b_valid ? "ok" : "FAILED");
+        b_passed &= b_valid == a_test->b_valid;
+    }
+    printf(b_passed ? "all passed\n" : "FAILED\n");
+    return b_passed ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,234 @@
+// $Id$
+/**
+ * @file threadtest.cpp
+ * @brief Host test of the structures shared between threads with APPTHREAD
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Runs the handoff primitives against a real second thread, the way the
+ * door thread and the application thread use them on the device:
+ *  - mailbox: results reach the caller, overlong arguments are refused and
+ *    a command reported as MAILBOX_BUSY never executes later
+ *  - snapshot: readers only ever see complete values, in order
+ *  - ring: items arrive complete and in order, none lost or repeated, for
+ *    many times the range of the indices, drops counted as overruns
+ * Build from the repository root and run, the exit code is non-zero on any
+ * failure:
+ *  g++ -std=gnu++11 -O2 -pthread -I replay -I . replay/threadtest.cpp mailbox.cpp -o garagio-threadtest
+ */
+// $Log$
+
+// host only, skipped when the directory is picked up by a device build
+#ifndef PLATFORM_ID
+
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include "application.h"
+#include "mailbox.h"
+#include "snapshot.h"
+#include "ring.h"
+
+// calls made through the mailbox in the ordinary run
+#define TEST_CALLS 1000
+// values published through the snapshot
+#define TEST_WRITES 200000
+// items passed through the ring, wraps the 16-bit indices many times
+#define TEST_ITEMS 1000000
+// ring size, small so it runs full often
+#define TEST_RINGSIZE 16
+// command argument which must never execute
+#define TEST_CANCELLED "-7"
+
+static const std::chrono::steady_clock::time_point a_start = std::chrono::steady_clock::now();
+
+uint32_t millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - a_start).count();
+}
+
+void delay(uint32_t n_ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(n_ms));
+}
+
+Thread::Thread(const char* s_name, void (*f_function)(void*), void* p_param, uint8_t n_priority) {
+    std::thread(f_function, p_param).detach();
+}
+
+static c_mailbox o_mailbox;
+static std::atomic<bool> b_paused(false);
+static std::atomic<bool> b_stop(false);
+static std::atomic<bool> b_stopped(false);
+static std::atomic<uint32_t> n_runs(0);
+static std::atomic<uint32_t> n_cancelledRuns(0);
+
+/**
+ * Stands in for the door commands, returns the argument as a number,
+ *  COMMAND_STATUSSINCE runs longer than the caller is willing to wait
+ */
+static int f_handler(mailboxCommand n_command, const char* s_args) {
+    n_runs++;
+    if (!strcmp(s_args, TEST_CANCELLED))
+        n_cancelledRuns++;
+    if (n_command == COMMAND_STATUSSINCE)
+        delay(MAILBOX_TIMEOUT + 500);
+    return atoi(s_args);
+}
+
+/**
+ * Door thread, serves the mailbox between passes unless paused
+ */
+static void f_doorThread(void* p_param) {
+    while (!b_stop) {
+        if (!b_paused)
+            o_mailbox.f_serve(f_handler);
+        std::this_thread::yield();
+    }
+    b_stopped = true;
+}
+
+static bool f_check(bool b_passed, const char* s_test) {
+    printf("%-40s %s\n", s_test, b_passed ? "ok" : "FAILED");
+    return b_passed;
+}
+
+static bool f_testMailbox() {
+    bool b_passed = true;
+    char s_args[MAILBOX_ARGSIZE + 1];
+
+    bool b_results = true;
+    for (int n_call = 0; n_call < TEST_CALLS; n_call++) {
+        sprintf(s_args, "%d", n_call);
+        b_results &= o_mailbox.f_call(COMMAND_SETSTATE, s_args) == n_call;
+    }
+    b_passed &= f_check(b_results && n_runs == TEST_CALLS, "mailbox results");
+
+    memset(s_args, '1', MAILBOX_ARGSIZE);
+    s_args[MAILBOX_ARGSIZE] = 0;
+    uint32_t n_before = n_runs;
+    b_passed &= f_check(o_mailbox.f_call(COMMAND_SETSTATE, s_args) == -1 && n_runs == n_before,
+        "mailbox refuses long argument");
+    s_args[MAILBOX_ARGSIZE - 1] = 0;
+    b_passed &= f_check(o_mailbox.f_call(COMMAND_SETSTATE, s_args) != MAILBOX_BUSY,
+        "mailbox takes longest argument");
+
+    // door thread busy elsewhere past the timeout, command is withdrawn
+    b_paused = true;
+    int n_result = o_mailbox.f_call(COMMAND_SETSTATE, TEST_CANCELLED);
+    b_paused = false;
+    b_passed &= f_check(n_result == MAILBOX_BUSY, "mailbox times out");
+    b_passed &= f_check(o_mailbox.f_call(COMMAND_SETSTATE, "8") == 8 && !n_cancelledRuns,
+        "mailbox drops timed out command");
+
+    // claimed before the timeout, the caller gets the result late
+    b_passed &= f_check(o_mailbox.f_call(COMMAND_STATUSSINCE, "9") == 9,
+        "mailbox waits for running command");
+    return b_passed;
+}
+
+typedef struct {
+    uint32_t n_value;
+    uint32_t a_copies[15];
+} testValue;
+
+static c_snapshot<testValue> o_snapshot;
+
+static void f_writerThread(void* p_param) {
+    testValue a_value;
+    for (uint32_t n_value = 1; n_value <= TEST_WRITES; n_value++) {
+        a_value.n_value = n_value;
+        for (uint8_t n_copy = 0; n_copy < 15; n_copy++)
+            a_value.a_copies[n_copy] = n_value;
+        o_snapshot.f_write(a_value);
+    }
+    b_stopped = true;
+}
+
+static bool f_testSnapshot() {
+    b_stopped = false;
+    Thread o_writer("writer", f_writerThread, NULL, OS_THREAD_PRIORITY_DEFAULT);
+    testValue a_value;
+    uint32_t n_last = 0;
+    uint32_t n_reads = 0;
+    bool b_complete = true;
+    bool b_ordered = true;
+    while (n_last < TEST_WRITES) {
+        o_snapshot.f_read(a_value);
+        n_reads++;
+        for (uint8_t n_copy = 0; n_copy < 15; n_copy++)
+            b_complete &= a_value.a_copies[n_copy] == a_value.n_value;
+        b_ordered &= a_value.n_value >= n_last;
+        n_last = a_value.n_value;
+    }
+    while (!b_stopped)
+        std::this_thread::yield();
+    bool b_passed = f_check(b_complete, "snapshot values complete");
+    b_passed &= f_check(b_ordered, "snapshot values in order");
+    printf("snapshot reads: %u\n", (unsigned)n_reads);
+    return b_passed;
+}
+
+typedef struct {
+    uint32_t n_value;
+    uint32_t n_check;
+} testItem;
+
+static c_ring<testItem, TEST_RINGSIZE> o_ring;
+static std::atomic<uint32_t> n_refused(0);
+
+/**
+ * Producer side, retries items refused by full ring so all get through
+ */
+static void f_producerThread(void* p_param) {
+    testItem a_item;
+    for (uint32_t n_value = 0; n_value < TEST_ITEMS; n_value++) {
+        a_item.n_value = n_value;
+        a_item.n_check = ~n_value;
+        while (!o_ring.f_push(a_item)) {
+            n_refused++;
+            std::this_thread::yield();
+        }
+    }
+    b_stopped = true;
+}
+
+static bool f_testRing() {
+    b_stopped = false;
+    Thread o_producer("producer", f_producerThread, NULL, OS_THREAD_PRIORITY_DEFAULT);
+    testItem a_item;
+    uint32_t n_expected = 0;
+    bool b_complete = true;
+    bool b_ordered = true;
+    while (n_expected < TEST_ITEMS) {
+        if (!o_ring.f_pop(a_item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        b_complete &= a_item.n_check == ~a_item.n_value;
+        b_ordered &= a_item.n_value == n_expected;
+        n_expected = a_item.n_value + 1;
+    }
+    while (!b_stopped)
+        std::this_thread::yield();
+    bool b_passed = f_check(b_complete, "ring items complete");
+    b_passed &= f_check(b_ordered, "ring items in order, no loss");
+    b_passed &= f_check(!o_ring.f_pop(a_item) && !o_ring.f_count(), "ring empty at the end");
+    b_passed &= f_check(o_ring.f_getOverruns() == (uint16_t)n_refused, "ring overruns counted");
+    printf("ring overruns: %u\n", (unsigned)n_refused);
+    return b_passed;
+}
+
+int main(int argc, char** argv) {
+    Thread o_door("door", f_doorThread, NULL, OS_THREAD_PRIORITY_DEFAULT);
+    bool b_passed = f_testMailbox();
+    b_stop = true;
+    while (!b_stopped)
+        std::this_thread::yield();
+
+    b_passed &= f_testSnapshot();
+    b_passed &= f_testRing();
+    printf(b_passed ? "all passed\n" : "FAILED\n");
+    return b_passed ? 0 : 1;
+}
+
+#endif
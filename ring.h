@@ -0,0 +1,88 @@
+// $Id$
+/**
+ * @file ring.h
+ * @brief Lock-free single-producer/single-consumer ring buffer
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Producer (e.g. an interrupt handler) only calls f_push(), consumer (main
+ * loop) only calls f_pop(), f_clear() and f_count(). Indices are published
+ * with release/acquire ordering so no locking or interrupt masking is needed.
+ * The header does not depend on the Particle platform and can be compiled on
+ * a host together with a thread simulating the interrupt.
+ */
+// $Log$
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint16_t N>
+class c_ring {
+
+    static_assert(N && !(N & (N - 1)), "ring size must be a power of two");
+
+protected:
+    T a_items[N];
+    std::atomic<uint16_t> n_head;
+    std::atomic<uint16_t> n_tail;
+    std::atomic<uint16_t> n_overruns;
+
+public:
+    c_ring() : n_head(0), n_tail(0), n_overruns(0) {}
+
+/**
+ * Adds item to the ring, producer side only
+ * @param[in] T a_item Item to add
+ * @return FALSE if the ring was full and the item was dropped
+ */
+    bool f_push(const T &a_item) {
+        uint16_t n_headNow = n_head.load(std::memory_order_relaxed);
+        if ((uint16_t)(n_headNow - n_tail.load(std::memory_order_acquire)) >= N) {
+            n_overruns.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        a_items[n_headNow & (N - 1)] = a_item;
+        n_head.store(n_headNow + 1, std::memory_order_release);
+        return true;
+    }
+
+/**
+ * Removes oldest item from the ring, consumer side only
+ * @param[out] T a_item Receives the item
+ * @return FALSE if the ring was empty
+ */
+    bool f_pop(T &a_item) {
+        uint16_t n_tailNow = n_tail.load(std::memory_order_relaxed);
+        if (n_tailNow == n_head.load(std::memory_order_acquire))
+            return false;
+        a_item = a_items[n_tailNow & (N - 1)];
+        n_tail.store(n_tailNow + 1, std::memory_order_release);
+        return true;
+    }
+
+/**
+ * Discards all queued items, consumer side only
+ */
+    void f_clear() {
+        n_tail.store(n_head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+/**
+ * Reports number of queued items
+ */
+    uint16_t f_count() {
+        return n_head.load(std::memory_order_acquire) - n_tail.load(std::memory_order_relaxed);
+    }
+
+/**
+ * Reports number of items dropped because the ring was full
+ */
+    uint16_t f_getOverruns() {
+        return n_overruns.load(std::memory_order_relaxed);
+    }
+};
+
+#endif
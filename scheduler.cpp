@@ -0,0 +1,121 @@
+// $Id$
+/**
+ * @file scheduler.cpp
+ * @brief Deadline ordered event scheduler
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "scheduler.h"
+
+int8_t c_scheduler::f_register(schedulerCallback f_callback, void* p_context) {
+    if (n_events >= SCHEDULER_MAXEVENTS)
+        return -1;
+    a_events[n_events].f_callback = f_callback;
+    a_events[n_events].p_context = p_context;
+    a_events[n_events].n_heapPos = SCHEDULER_MAXEVENTS;
+    return n_events++;
+}
+
+void c_scheduler::f_schedule(int8_t n_event, uint32_t n_delay) {
+    if (!f_isValid(n_event))
+        return;
+    schedulerEvent* a_event = &a_events[n_event];
+    a_event->n_deadline = millis() + n_delay;
+    if (a_event->n_heapPos == SCHEDULER_MAXEVENTS) {
+        a_event->n_heapPos = n_heapSize;
+        a_heap[n_heapSize++] = n_event;
+        f_siftUp(a_event->n_heapPos);
+    }
+    else {
+        // deadline may have moved either way
+        f_siftUp(a_event->n_heapPos);
+        f_siftDown(a_event->n_heapPos);
+    }
+}
+
+void c_scheduler::f_cancel(int8_t n_event) {
+    if (f_isValid(n_event) && a_events[n_event].n_heapPos != SCHEDULER_MAXEVENTS)
+        f_remove(a_events[n_event].n_heapPos);
+}
+
+bool c_scheduler::f_isPending(int8_t n_event) {
+    return f_isValid(n_event) && a_events[n_event].n_heapPos != SCHEDULER_MAXEVENTS;
+}
+
+uint32_t c_scheduler::f_timeLeft(int8_t n_event) {
+    if (!f_isPending(n_event))
+        return SCHEDULER_NEVER;
+    int32_t n_left = a_events[n_event].n_deadline - millis();
+    return n_left > 0 ? n_left : 0;
+}
+
+uint32_t c_scheduler::f_timeUntilNext() {
+    return n_heapSize ? f_timeLeft(a_heap[0]) : SCHEDULER_NEVER;
+}
+
+void c_scheduler::f_process() {
+    uint32_t n_now = millis();
+    while (n_heapSize && (int32_t)(n_now - a_events[a_heap[0]].n_deadline) >= 0) {
+        schedulerEvent* a_event = &a_events[a_heap[0]];
+        f_remove(0);
+        a_event->f_callback(a_event->p_context);
+    }
+}
+
+/**
+ * Checks event id was returned by f_register()
+ */
+bool c_scheduler::f_isValid(int8_t n_event) {
+    return n_event >= 0 && n_event < n_events;
+}
+
+/**
+ * Compares deadlines of two heap entries, safe for millis() rollover
+ */
+bool c_scheduler::f_isEarlier(uint8_t n_heapA, uint8_t n_heapB) {
+    return (int32_t)(a_events[a_heap[n_heapA]].n_deadline - a_events[a_heap[n_heapB]].n_deadline) < 0;
+}
+
+void c_scheduler::f_swap(uint8_t n_heapA, uint8_t n_heapB) {
+    uint8_t n_event = a_heap[n_heapA];
+    a_heap[n_heapA] = a_heap[n_heapB];
+    a_heap[n_heapB] = n_event;
+    a_events[a_heap[n_heapA]].n_heapPos = n_heapA;
+    a_events[a_heap[n_heapB]].n_heapPos = n_heapB;
+}
+
+void c_scheduler::f_siftUp(uint8_t n_heapPos) {
+    while (n_heapPos && f_isEarlier(n_heapPos, (n_heapPos - 1) / 2)) {
+        f_swap(n_heapPos, (n_heapPos - 1) / 2);
+        n_heapPos = (n_heapPos - 1) / 2;
+    }
+}
+
+void c_scheduler::f_siftDown(uint8_t n_heapPos) {
+    while (TRUE) {
+        uint8_t n_child = n_heapPos * 2 + 1;
+        if (n_child >= n_heapSize)
+            return;
+        if (n_child + 1 < n_heapSize && f_isEarlier(n_child + 1, n_child))
+            n_child++;
+        if (!f_isEarlier(n_child, n_heapPos))
+            return;
+        f_swap(n_heapPos, n_child);
+        n_heapPos = n_child;
+    }
+}
+
+/**
+ * Removes heap entry by moving the last entry in its place
+ */
+void c_scheduler::f_remove(uint8_t n_heapPos) {
+    a_events[a_heap[n_heapPos]].n_heapPos = SCHEDULER_MAXEVENTS;
+    if (--n_heapSize == n_heapPos)
+        return;
+    a_heap[n_heapPos] = a_heap[n_heapSize];
+    a_events[a_heap[n_heapPos]].n_heapPos = n_heapPos;
+    f_siftUp(n_heapPos);
+    f_siftDown(n_heapPos);
+}
@@ -0,0 +1,100 @@
+// $Id$
+/**
+ * @file scheduler.h
+ * @brief Deadline ordered event scheduler
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Events are kept in a binary min-heap ordered by deadline so the main loop
+ * only has to check the earliest one. Times are millis() based and compared
+ * in a rollover safe way, so durations up to 24 days are supported.
+ * Event ids not returned by f_register() are ignored by all methods, so a
+ * failed registration leaves its owner with a timer that never fires.
+ */
+// $Log$
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "application.h"
+
+// maximum number of registered events
+#define SCHEDULER_MAXEVENTS 16
+// returned by time queries when nothing is scheduled
+#define SCHEDULER_NEVER 0xFFFFFFFF
+
+typedef void (*schedulerCallback)(void* p_context);
+
+class c_scheduler {
+
+    typedef struct {
+        uint32_t n_deadline;
+        schedulerCallback f_callback;
+        void* p_context;
+        // position in heap or SCHEDULER_MAXEVENTS if not scheduled
+        uint8_t n_heapPos;
+    } schedulerEvent;
+
+protected:
+    schedulerEvent a_events[SCHEDULER_MAXEVENTS];
+    uint8_t a_heap[SCHEDULER_MAXEVENTS];
+    uint8_t n_events = 0;
+    uint8_t n_heapSize = 0;
+
+public:
+
+/**
+ * Registers event callback
+ * @param[in] schedulerCallback f_callback Function called when event is due
+ * @param[in] void* p_context Passed to the callback
+ * @return Event id or -1 if there are no free slots
+ */
+    int8_t f_register(schedulerCallback f_callback, void* p_context);
+
+/**
+ * Schedules or re-schedules event relative to current time
+ * @param[in] int8_t n_event Event id
+ * @param[in] uint32_t n_delay Delay in milliseconds
+ */
+    void f_schedule(int8_t n_event, uint32_t n_delay);
+
+/**
+ * Cancels the event without calling the callback
+ * @param[in] int8_t n_event Event id
+ */
+    void f_cancel(int8_t n_event);
+
+/**
+ * Reports if event is scheduled
+ * @param[in] int8_t n_event Event id
+ */
+    bool f_isPending(int8_t n_event);
+
+/**
+ * Reports time left until the event
+ * @return Time in milliseconds, zero if due or SCHEDULER_NEVER if not pending
+ */
+    uint32_t f_timeLeft(int8_t n_event);
+
+/**
+ * Reports time until the earliest event, O(1)
+ * @return Time in milliseconds, zero if due or SCHEDULER_NEVER if idle
+ */
+    uint32_t f_timeUntilNext();
+
+/**
+ * Calls callbacks of all due events in deadline order. Callbacks may
+ *  schedule or cancel events including their own.
+ */
+    void f_process();
+
+protected:
+    bool f_isValid(int8_t n_event);
+    bool f_isEarlier(uint8_t n_heapA, uint8_t n_heapB);
+    void f_swap(uint8_t n_heapA, uint8_t n_heapB);
+    void f_siftUp(uint8_t n_heapPos);
+    void f_siftDown(uint8_t n_heapPos);
+    void f_remove(uint8_t n_heapPos);
+};
+
+#endif
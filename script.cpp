@@ -0,0 +1,153 @@
+// $Id$
+/**
+ * @file script.cpp
+ * @brief Command scripts for the setState function
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "script.h"
+
+/**
+ * Copies next word of the step, stops at space, semicolon or end of text
+ * @param[out] char* s_token Word, empty at the end of step,
+ *  SCRIPT_MAXARG + 1 bytes
+ * @return position after the word or NULL if the word is too long
+ */
+const char* c_script::f_token(const char* s_text, char* s_token) {
+    while (*s_text == ' ')
+        s_text++;
+    uint8_t n_length = 0;
+    while (*s_text && *s_text != ' ' && *s_text != ';') {
+        if (n_length == SCRIPT_MAXARG)
+            return NULL;
+        s_token[n_length++] = *s_text++;
+    }
+    s_token[n_length] = 0;
+    return s_text;
+}
+
+/**
+ * Converts time argument, digits only and within SCRIPT_MAXTIME
+ */
+bool c_script::f_number(const char* s_token, uint32_t* p_value) {
+    if (!*s_token)
+        return false;
+    uint32_t n_value = 0;
+    for (; *s_token; s_token++) {
+        if (*s_token < '0' || *s_token > '9')
+            return false;
+        n_value = n_value * 10 + *s_token - '0';
+        if (n_value > SCRIPT_MAXTIME)
+            return false;
+    }
+    *p_value = n_value;
+    return true;
+}
+
+/**
+ * Checks event name of publish step, empty selects SCRIPT_EVENT
+ * @return false if the name is too long to take door number or starts
+ *  with the name of an event published by the firmware itself, which
+ *  covers other doors (state2) and prefix matching subscriptions
+ */
+bool c_script::f_isEvent(const char* s_token) {
+    if (strlen(s_token) > SCRIPT_MAXEVENT)
+        return false;
+    static const char* const a_reserved[] = SCRIPT_RESERVED;
+    for (uint8_t n_name = 0; n_name < sizeof(a_reserved) / sizeof(a_reserved[0]); n_name++)
+        if (!strncmp(s_token, a_reserved[n_name], strlen(a_reserved[n_name])))
+            return false;
+    return true;
+}
+
+int16_t c_script::f_load(const char* s_script, bool (*f_isState)(const char*)) {
+    // parsed aside so invalid script leaves running one intact
+    scriptStep a_parsed[SCRIPT_MAXSTEPS];
+    uint8_t n_parsed = 0;
+    char s_word[SCRIPT_MAXARG + 1];
+    const char* s_pos = s_script;
+
+    while (*s_pos) {
+        if (!(s_pos = f_token(s_pos, s_word)))
+            return -1;
+        // empty step
+        if (!*s_word) {
+            if (*s_pos == ';')
+                s_pos++;
+            continue;
+        }
+        if (n_parsed == SCRIPT_MAXSTEPS)
+            return -1;
+
+        scriptStep* a_step = &a_parsed[n_parsed++];
+        a_step->s_arg[0] = 0;
+        a_step->n_time = 0;
+        if (!strcmp(s_word, "wait")) {
+            a_step->n_op = SCRIPT_WAIT;
+            if (!(s_pos = f_token(s_pos, s_word)) || !f_number(s_word, &a_step->n_time))
+                return -1;
+        }
+        else if (!strcmp(s_word, "await")) {
+            a_step->n_op = SCRIPT_AWAIT;
+            if (!(s_pos = f_token(s_pos, a_step->s_arg)) || !f_isState(a_step->s_arg))
+                return -1;
+            if (!(s_pos = f_token(s_pos, s_word)) || !f_number(s_word, &a_step->n_time))
+                return -1;
+        }
+        else if (!strcmp(s_word, "publish")) {
+            a_step->n_op = SCRIPT_PUBLISH;
+            if (!(s_pos = f_token(s_pos, a_step->s_arg)) || !f_isEvent(a_step->s_arg))
+                return -1;
+            if (!*a_step->s_arg)
+                strcpy(a_step->s_arg, SCRIPT_EVENT);
+        }
+        else if (f_isState(s_word)) {
+            a_step->n_op = SCRIPT_STATE;
+            strcpy(a_step->s_arg, s_word);
+        }
+        else
+            return -1;
+
+        // nothing else is allowed before the end of step
+        if (!(s_pos = f_token(s_pos, s_word)) || *s_word)
+            return -1;
+        if (*s_pos == ';')
+            s_pos++;
+    }
+    if (!n_parsed)
+        return -1;
+
+    memcpy(a_steps, a_parsed, n_parsed * sizeof(scriptStep));
+    n_steps = n_parsed;
+    n_step = 0;
+    n_lastId = n_lastId % 32767 + 1;
+    n_id = n_lastId;
+    return n_id;
+}
+
+const scriptStep* c_script::f_current() {
+    return n_step < n_steps ? &a_steps[n_step] : NULL;
+}
+
+void c_script::f_next() {
+    if (n_step < n_steps)
+        n_step++;
+}
+
+void c_script::f_stop() {
+    n_step = n_steps;
+}
+
+bool c_script::f_isRunning() {
+    return n_step < n_steps;
+}
+
+uint16_t c_script::f_getId() {
+    return n_id;
+}
+
+uint8_t c_script::f_getStep() {
+    return n_step;
+}
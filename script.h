@@ -0,0 +1,104 @@
+// $Id$
+/**
+ * @file script.h
+ * @brief Command scripts for the setState function
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * A script is a short list of steps separated by semicolons, e.g.
+ *  close; await closed 15000; publish
+ * Steps:
+ *  <state>                 request door state as plain setState does
+ *  wait <mS>               pause
+ *  await <state> <mS>      pause until the door reports the state, the
+ *                          script fails if it does not within the time
+ *  publish [event]         publish script id and door state, event name
+ *                          defaults to "script", up to SCRIPT_MAXEVENT
+ *                          characters and not starting with the name of
+ *                          a firmware event
+ * The script is parsed as a whole when received so nothing runs if any step
+ * is invalid. This class only holds the steps and the position, the door
+ * executes them as its state changes and timers expire.
+ */
+// $Log$
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include "application.h"
+#include "global.h"
+#include "publisher.h"
+
+// maximum number of steps in a script
+#define SCRIPT_MAXSTEPS 8
+// longest step argument, state or event name
+#define SCRIPT_MAXARG 11
+// longest wait or await time (mS)
+#define SCRIPT_MAXTIME 600000
+// default event name of publish step
+#define SCRIPT_EVENT "script"
+// longest event name of publish step, leaves room for door number
+#define SCRIPT_MAXEVENT (PUBLISH_NAMESIZE - 2)
+// event names published by the firmware itself, not allowed in scripts
+// with or without anything appended
+#define SCRIPT_RESERVED {"state", "config", "timeout", "night", "outage", PUBLISH_BATCHEVENT}
+
+enum scriptOp {
+    SCRIPT_STATE,
+    SCRIPT_WAIT,
+    SCRIPT_AWAIT,
+    SCRIPT_PUBLISH
+};
+
+typedef struct {
+    scriptOp n_op;
+    char s_arg[SCRIPT_MAXARG + 1];
+    uint32_t n_time;
+} scriptStep;
+
+class c_script {
+
+protected:
+    scriptStep a_steps[SCRIPT_MAXSTEPS];
+    uint8_t n_steps = 0;
+    uint8_t n_step = 0;
+    uint16_t n_id = 0;
+    uint16_t n_lastId = 0;
+
+    static const char* f_token(const char* s_text, char* s_token);
+    static bool f_number(const char* s_token, uint32_t* p_value);
+    static bool f_isEvent(const char* s_token);
+
+public:
+
+/**
+ * Parses script and makes it current, running script is replaced
+ * @param[in] const char* s_script Script text
+ * @param[in] bool (*f_isState)(const char*) Checks state names
+ * @return script id or -1 if the script is invalid, running script is kept
+ *  in that case
+ */
+    int16_t f_load(const char* s_script, bool (*f_isState)(const char*));
+
+/**
+ * Returns step to execute
+ * @return step or NULL when no script is running
+ */
+    const scriptStep* f_current();
+
+/**
+ * Moves to the next step, script ends after the last one
+ */
+    void f_next();
+
+/**
+ * Ends running script
+ */
+    void f_stop();
+
+    bool f_isRunning();
+    uint16_t f_getId();
+    uint8_t f_getStep();
+};
+
+#endif
@@ -3,45 +3,234 @@
  * @file sensor.cpp
  * @brief Laser sensor related functionality
  * @author Denis Grisak
- * @version 1.0
+ * @version 1.1
  */
 // $Log$
 
 #include "sensor.h"
+#include "profiler.h"
+#include "trace.h"
 
-c_sensor::c_sensor() {
-    pinMode(PIN_LASER, OUTPUT);
-    digitalWrite(PIN_LASER, LOW);
+c_sensor* c_sensor::p_active = NULL;
+uint8_t c_sensor::n_waiting = 0;
+
+#if APPSENSORISR
+IntervalTimer c_sensor::o_timer;
+c_ring<c_sensor::samplePair, SENSOR_RINGSIZE> c_sensor::o_samples;
+volatile uint8_t c_sensor::n_isrPhase;
+volatile uint16_t c_sensor::n_isrAmbient;
+#endif
+
+c_sensor::c_sensor(uint8_t n_laser, uint8_t n_photo) {
+    n_pinLaser = n_laser;
+    n_pinPhoto = n_photo;
+    pinMode(n_pinLaser, OUTPUT);
+    digitalWrite(n_pinLaser, LOW);
 }
 
-void c_sensor::f_setParams(uint8_t n_readsParam, uint8_t n_thresholdParam) {
+void c_sensor::f_setParams(uint8_t n_readsParam, uint8_t n_thresholdParam, bool b_sequentialParam) {
     n_reads = n_readsParam;
     n_threshold = n_thresholdParam;
+    b_sequential = b_sequentialParam;
+}
+
+void c_sensor::f_startRead() {
+    if (n_readState != READ_IDLE)
+        return;
+    n_readState = READ_WAITING;
+    n_waiting++;
+}
+
+/**
+ * Takes over the acquisition hardware and starts the batch
+ */
+void c_sensor::f_beginRead() {
+    p_active = this;
+    n_waiting--;
+    n_readsLeft = n_reads;
+    n_sum1 = 0;
+    n_sum2 = 0;
+    n_samples = 0;
+    n_sumSq1 = 0;
+    n_sumSq2 = 0;
+    n_sumCross = 0;
+    n_readState = READ_AMBIENT;
+    n_stepDeadline = micros();
+    #if APPSENSORISR
+        o_samples.f_clear();
+        n_isrPhase = 0;
+        o_timer.begin(f_isrSample, SENSOR_LITTIME, uSec);
+    #endif
 }
 
-uint8_t c_sensor::f_read() {
+/**
+ * Each sample is taken in two steps: ambient light is read with laser off
+ *  then laser is turned on and after settling time the lit value is read.
+ *  Laser stays off between the samples to let the sensor settle.
+ */
+bool c_sensor::f_processRead() {
+
+    PROFILE(PROFILE_SENSOR);
+
+    if (n_readState == READ_IDLE)
+        return FALSE;
+    if (n_readState == READ_WAITING) {
+        if (p_active)
+            return FALSE;
+        f_beginRead();
+    }
+
+    #if APPSENSORISR
+        samplePair a_pair;
+        while (n_readsLeft && !f_isConclusive() && o_samples.f_pop(a_pair))
+            f_addSample(a_pair.n_ambient, a_pair.n_lit);
+        if (n_readsLeft && !f_isConclusive())
+            return FALSE;
+        o_timer.end();
+        digitalWriteFast(n_pinLaser, LOW);
+        return f_completeRead();
+    #else
+        if (!f_isDeadline())
+            return FALSE;
+
+        if (n_readState == READ_AMBIENT) {
+            n_ambientValue = analogRead(n_pinPhoto);
+            digitalWriteFast(n_pinLaser, HIGH);
+            n_stepDeadline = micros() + SENSOR_LITTIME;
+            n_readState = READ_LIT;
+            return FALSE;
+        }
 
-    int n_value;
-    long n_sum1 = 0,
-        n_sum2 = 0;
+        f_addSample(n_ambientValue, analogRead(n_pinPhoto));
+        digitalWriteFast(n_pinLaser, LOW);
+        n_stepDeadline = micros() + SENSOR_DARKTIME;
+        if (n_readsLeft && !f_isConclusive()) {
+            n_readState = READ_AMBIENT;
+            return FALSE;
+        }
+        return f_completeRead();
+    #endif
+}
 
-    for (uint8_t n_read = n_reads; n_read > 0; n_read--) {
-        n_value = analogRead(PIN_PHOTO);
-        n_sum1 += n_value;
-        digitalWriteFast(PIN_LASER, HIGH);
-        delayMicroseconds(500);
-        n_sum2 += n_value - analogRead(PIN_PHOTO);
-        digitalWriteFast(PIN_LASER, LOW);
-        delayMicroseconds(1000);
+/**
+ * Accumulates one ambient/lit sample pair
+ */
+void c_sensor::f_addSample(int n_ambient, int n_lit) {
+    TRACE_SAMPLE(n_pinPhoto, n_ambient, n_lit);
+    n_sum1 += n_ambient;
+    n_sum2 += n_ambient - n_lit;
+    n_readsLeft--;
+    n_samples++;
+    if (b_sequential) {
+        int n_drop = n_ambient - n_lit;
+        n_sumSq1 += n_ambient * n_ambient;
+        n_sumSq2 += n_drop * n_drop;
+        n_sumCross += n_ambient * n_drop;
     }
-    return n_sum1 ? (float)n_sum2 * 100 / n_sum1 : 0;
+}
+
+/**
+ * Sequential test: reading is conclusive when the threshold lies outside of
+ *  the confidence interval of the reading of samples taken so far. The
+ *  reading is the ratio of sums reported by @see f_completeRead(), its
+ *  spread is taken from residuals of samples around it (drop minus reading
+ *  times ambient) so the test and the result always agree. Residuals are
+ *  summed in 64-bit integers scaled by squared ambient sum, which holds
+ *  for the 20 12-bit samples srr allows. Compared in squared form to avoid
+ *  square root.
+ */
+bool c_sensor::f_isConclusive() {
+    if (!b_sequential || n_samples < SENSOR_SEQMINREADS || n_sum1 <= 0)
+        return FALSE;
+
+    int64_t n_residual = (int64_t)n_sumSq2 * n_sum1 * n_sum1
+        - 2 * (int64_t)n_sum2 * n_sum1 * n_sumCross
+        + (int64_t)n_sum2 * n_sum2 * n_sumSq1;
+    if (n_residual < 0)
+        n_residual = 0;
+    // per-sample deviation in % of the mean ambient level
+    float n_scale = 100.0f * n_samples / n_sum1;
+    float n_variance = (float)n_residual / ((float)n_sum1 * n_sum1) / (n_samples - 1) * n_scale * n_scale;
+    if (n_variance < SENSOR_SEQMINDEVIATION * SENSOR_SEQMINDEVIATION)
+        n_variance = SENSOR_SEQMINDEVIATION * SENSOR_SEQMINDEVIATION;
+
+    float n_distance = (float)n_sum2 * 100 / n_sum1 - n_threshold;
+    return n_distance * n_distance * n_samples >
+        SENSOR_SEQCONFIDENCE * SENSOR_SEQCONFIDENCE * n_variance;
+}
+
+/**
+ * Calculates the reading from accumulated samples and ends the batch
+ */
+bool c_sensor::f_completeRead() {
+    n_readState = READ_IDLE;
+    p_active = NULL;
+    n_lastSamples = n_samples;
+    n_totalSamples += n_samples;
+    n_totalScans++;
+    n_lastReadValue = n_sum1 ? (float)n_sum2 * 100 / n_sum1 : 0;
+    return TRUE;
+}
+
+#if APPSENSORISR
+/**
+ * Timer interrupt handler, called every SENSOR_LITTIME uS while reading.
+ *  Cycle takes three ticks: ambient read and laser on, lit read and laser
+ *  off, then one more tick with laser off so it stays dark for
+ *  SENSOR_DARKTIME before the next sample.
+ */
+void c_sensor::f_isrSample() {
+    switch (n_isrPhase) {
+        case 0:
+            n_isrAmbient = analogRead(p_active->n_pinPhoto);
+            digitalWriteFast(p_active->n_pinLaser, HIGH);
+            n_isrPhase = 1;
+            break;
+        case 1:
+            samplePair a_pair;
+            a_pair.n_ambient = n_isrAmbient;
+            a_pair.n_lit = analogRead(p_active->n_pinPhoto);
+            digitalWriteFast(p_active->n_pinLaser, LOW);
+            o_samples.f_push(a_pair);
+            n_isrPhase = 2;
+            break;
+        default:
+            n_isrPhase = 0;
+    }
+}
+#endif
+
+bool c_sensor::f_isReading() {
+    return n_readState != READ_IDLE;
+}
+
+bool c_sensor::f_isBusy() {
+    return p_active || n_waiting;
+}
+
+/**
+ * Checks if the current step's deadline has passed, safe for micros() rollover
+ */
+bool c_sensor::f_isDeadline() {
+    return (int32_t)(micros() - n_stepDeadline) >= 0;
 }
 
 bool c_sensor::f_isTripping() {
-    n_lastReadValue = f_read();
     return n_lastReadValue > n_threshold;
 }
 
 uint8_t c_sensor::f_getLastReading() {
     return n_lastReadValue;
 }
+
+uint8_t c_sensor::f_getLastSamples() {
+    return n_lastSamples;
+}
+
+uint32_t c_sensor::f_getTotalSamples() {
+    return n_totalSamples;
+}
+
+uint32_t c_sensor::f_getTotalScans() {
+    return n_totalScans;
+}
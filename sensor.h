@@ -3,7 +3,7 @@
  * @file sensor.h
  * @brief Laser sensor related functionality
  * @author Denis Grisak
- * @version 1.0
+ * @version 1.1
  */
 // $Log$
 
@@ -13,22 +13,147 @@
 #include "timeout.h"
 #include "global.h"
 
+#if APPSENSORISR
+    #include "SparkIntervalTimer.h"
+    #include "ring.h"
+#endif
+
+// time for the photo sensor to settle after laser is turned on (uS)
+#define SENSOR_LITTIME 500
+// time for the photo sensor to settle after laser is turned off (uS)
+#define SENSOR_DARKTIME 1000
+// number of sample pairs buffered between interrupt and main loop
+#define SENSOR_RINGSIZE 32
+// minimum number of samples before sequential mode may stop early, two
+// samples give too rough a variance estimate
+#define SENSOR_SEQMINREADS 3
+// confidence (in standard errors) required to stop sampling early
+#define SENSOR_SEQCONFIDENCE 3
+// lower bound for per-sample deviation (%) so few identical samples
+// are not taken as certain
+#define SENSOR_SEQMINDEVIATION 2
+
 class c_sensor {
 
+    enum readState {
+        READ_IDLE,
+        READ_WAITING,
+        READ_AMBIENT,
+        READ_LIT
+    };
+
+    typedef struct {
+        uint16_t n_ambient;
+        uint16_t n_lit;
+    } samplePair;
+
 protected:
+    uint8_t n_pinLaser;
+    uint8_t n_pinPhoto;
     uint8_t n_reads = 3;
     uint8_t n_threshold = 25;
-    uint8_t n_lastReadValue;
+    bool b_sequential = FALSE;
+    uint8_t n_lastReadValue = 0;
+    uint8_t n_lastSamples = 0;
+    uint32_t n_totalSamples = 0;
+    uint32_t n_totalScans = 0;
+
+    // acquisition in progress
+    readState n_readState = READ_IDLE;
+    uint8_t n_readsLeft;
+    uint32_t n_stepDeadline;
+    int n_ambientValue;
+    long n_sum1;
+    long n_sum2;
+    uint8_t n_samples;
+    // sums of squares and products of ambient and drop values for the
+    // sequential test, exact in integers
+    uint32_t n_sumSq1;
+    uint32_t n_sumSq2;
+    int32_t n_sumCross;
+
+    // only one sensor acquires at a time so multiple doors do not add up
+    // blocking time and lasers do not interfere
+    static c_sensor* p_active;
+    static uint8_t n_waiting;
+
+#if APPSENSORISR
+    // interrupt side of the acquisition, runs one step per timer tick
+    static IntervalTimer o_timer;
+    static c_ring<samplePair, SENSOR_RINGSIZE> o_samples;
+    static volatile uint8_t n_isrPhase;
+    static volatile uint16_t n_isrAmbient;
+#endif
 
 public:
-    c_sensor();
-    void f_setParams(uint8_t n_readsParam, uint8_t n_thresholdParam);
+/**
+ * Sensor constructor
+ * @param[in] uint8_t n_laser Laser pin
+ * @param[in] uint8_t n_photo Photo sensor analog pin
+ */
+    c_sensor(uint8_t n_laser, uint8_t n_photo);
+/**
+ * Sets sensor parameters
+ * @param[in] uint8_t n_readsParam Number of samples per reading, maximum
+ *  number in sequential mode
+ * @param[in] uint8_t n_thresholdParam Brightness change that trips the sensor
+ * @param[in] bool b_sequentialParam Stop sampling once result is unambiguous
+ */
+    void f_setParams(uint8_t n_readsParam, uint8_t n_thresholdParam, bool b_sequentialParam = FALSE);
+
+/**
+ * Requests new batch of sensor reads. Readings are taken incrementally by
+ *  subsequent calls to @see f_processRead() once no other sensor is reading
+ */
+    void f_startRead();
+
+/**
+ * Advances acquisition by at most one laser-off/laser-on step or, in interrupt
+ *  mode, drains sample pairs queued by the timer interrupt. Never blocks,
+ *  has to be called periodically while @see f_isReading() is TRUE
+ * @return TRUE one time when the batch of reads is completed
+ */
+    bool f_processRead();
+
+/**
+ * Reports if batch of reads is requested or in progress
+ * @return TRUE while acquisition is running
+ */
+    bool f_isReading();
+
+/**
+ * Reports if any of the sensors is reading or waiting to read
+ */
+    static bool f_isBusy();
+
+/**
+ * Reports the result of the last completed batch of reads
+ * @return TRUE if the beam was blocked
+ */
     bool f_isTripping();
     uint8_t f_getLastReading();
 
-protected:
-    uint8_t f_read();
+/**
+ * Reports number of samples taken for the last reading
+ */
+    uint8_t f_getLastSamples();
 
+/**
+ * Reports total number of samples and readings since boot, used to evaluate
+ *  sequential mode savings
+ */
+    uint32_t f_getTotalSamples();
+    uint32_t f_getTotalScans();
+
+protected:
+    bool f_isDeadline();
+    void f_beginRead();
+    void f_addSample(int n_ambient, int n_lit);
+    bool f_isConclusive();
+    bool f_completeRead();
+#if APPSENSORISR
+    static void f_isrSample();
+#endif
 };
 
 #endif
@@ -0,0 +1,123 @@
+// $Id$
+/**
+ * @file sha256.cpp
+ * @brief SHA-256 hash and HMAC for request authentication
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "sha256.h"
+
+#define ROTR(n_value, n_bits) ((n_value) >> (n_bits) | (n_value) << (32 - (n_bits)))
+
+static const uint32_t a_rounds[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+c_sha256::c_sha256() {
+    f_reset();
+}
+
+void c_sha256::f_reset() {
+    static const uint32_t a_initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(a_state, a_initial, sizeof(a_state));
+    n_blockUsed = 0;
+    n_length = 0;
+}
+
+/**
+ * Hashes the full block into the state
+ */
+void c_sha256::f_compress() {
+    uint32_t a_words[64];
+    for (uint8_t n_word = 0; n_word < 16; n_word++)
+        a_words[n_word] = (uint32_t)a_block[n_word * 4] << 24 | (uint32_t)a_block[n_word * 4 + 1] << 16
+            | (uint32_t)a_block[n_word * 4 + 2] << 8 | a_block[n_word * 4 + 3];
+    for (uint8_t n_word = 16; n_word < 64; n_word++) {
+        uint32_t n_s0 = ROTR(a_words[n_word - 15], 7) ^ ROTR(a_words[n_word - 15], 18) ^ a_words[n_word - 15] >> 3;
+        uint32_t n_s1 = ROTR(a_words[n_word - 2], 17) ^ ROTR(a_words[n_word - 2], 19) ^ a_words[n_word - 2] >> 10;
+        a_words[n_word] = a_words[n_word - 16] + n_s0 + a_words[n_word - 7] + n_s1;
+    }
+
+    uint32_t a[8];
+    memcpy(a, a_state, sizeof(a));
+    for (uint8_t n_round = 0; n_round < 64; n_round++) {
+        uint32_t n_t1 = a[7] + (ROTR(a[4], 6) ^ ROTR(a[4], 11) ^ ROTR(a[4], 25))
+            + ((a[4] & a[5]) ^ (~a[4] & a[6])) + a_rounds[n_round] + a_words[n_round];
+        uint32_t n_t2 = (ROTR(a[0], 2) ^ ROTR(a[0], 13) ^ ROTR(a[0], 22))
+            + ((a[0] & a[1]) ^ (a[0] & a[2]) ^ (a[1] & a[2]));
+        memmove(a + 1, a, 7 * sizeof(uint32_t));
+        a[4] += n_t1;
+        a[0] = n_t1 + n_t2;
+    }
+    for (uint8_t n_word = 0; n_word < 8; n_word++)
+        a_state[n_word] += a[n_word];
+}
+
+void c_sha256::f_update(const void* p_data, size_t n_size) {
+    const uint8_t* a_data = (const uint8_t*)p_data;
+    n_length += n_size;
+    while (n_size--) {
+        a_block[n_blockUsed++] = *a_data++;
+        if (n_blockUsed == SHA256_BLOCKSIZE) {
+            f_compress();
+            n_blockUsed = 0;
+        }
+    }
+}
+
+void c_sha256::f_finish(uint8_t* a_hash) {
+    // length in bits, messages here are far below 512MB
+    uint32_t n_bits = n_length << 3;
+    uint8_t n_pad = 0x80;
+    f_update(&n_pad, 1);
+    n_pad = 0;
+    while (n_blockUsed != SHA256_BLOCKSIZE - 8)
+        f_update(&n_pad, 1);
+    uint8_t a_bits[8] = {0, 0, 0, (uint8_t)(n_length >> 29),
+        (uint8_t)(n_bits >> 24), (uint8_t)(n_bits >> 16), (uint8_t)(n_bits >> 8), (uint8_t)n_bits};
+    f_update(a_bits, 8);
+    for (uint8_t n_word = 0; n_word < 8; n_word++) {
+        a_hash[n_word * 4] = a_state[n_word] >> 24;
+        a_hash[n_word * 4 + 1] = a_state[n_word] >> 16;
+        a_hash[n_word * 4 + 2] = a_state[n_word] >> 8;
+        a_hash[n_word * 4 + 3] = a_state[n_word];
+    }
+}
+
+void c_sha256::f_hmac(const void* p_key, size_t n_keySize, const void* p_message, size_t n_size, uint8_t* a_mac) {
+    c_sha256 o_hash;
+    uint8_t a_key[SHA256_BLOCKSIZE] = {0};
+    if (n_keySize > SHA256_BLOCKSIZE) {
+        o_hash.f_update(p_key, n_keySize);
+        o_hash.f_finish(a_key);
+        o_hash.f_reset();
+    }
+    else
+        memcpy(a_key, p_key, n_keySize);
+
+    uint8_t a_pad[SHA256_BLOCKSIZE];
+    for (uint8_t n_byte = 0; n_byte < SHA256_BLOCKSIZE; n_byte++)
+        a_pad[n_byte] = a_key[n_byte] ^ 0x36;
+    o_hash.f_update(a_pad, SHA256_BLOCKSIZE);
+    o_hash.f_update(p_message, n_size);
+    uint8_t a_inner[SHA256_SIZE];
+    o_hash.f_finish(a_inner);
+
+    o_hash.f_reset();
+    for (uint8_t n_byte = 0; n_byte < SHA256_BLOCKSIZE; n_byte++)
+        a_pad[n_byte] = a_key[n_byte] ^ 0x5c;
+    o_hash.f_update(a_pad, SHA256_BLOCKSIZE);
+    o_hash.f_update(a_inner, SHA256_SIZE);
+    o_hash.f_finish(a_mac);
+}
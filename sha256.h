@@ -0,0 +1,61 @@
+// $Id$
+/**
+ * @file sha256.h
+ * @brief SHA-256 hash and HMAC for request authentication
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Plain FIPS 180-4 implementation working on a 64-byte block in the object,
+ * input is hashed as it arrives so nothing is buffered beyond one block.
+ * Used by the local network endpoint to check request signatures, the
+ * same HMAC-SHA256 is available in standard libraries of the clients.
+ */
+// $Log$
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include "application.h"
+
+// size of the hash (bytes)
+#define SHA256_SIZE 32
+// size of the block hashed in one step (bytes)
+#define SHA256_BLOCKSIZE 64
+
+class c_sha256 {
+
+protected:
+    uint32_t a_state[8];
+    uint8_t a_block[SHA256_BLOCKSIZE];
+    uint8_t n_blockUsed;
+    uint32_t n_length;
+
+    void f_compress();
+
+public:
+    c_sha256();
+
+/**
+ * Adds data to the hash
+ */
+    void f_update(const void* p_data, size_t n_size);
+
+/**
+ * Completes the hash, the object has to be reset before reuse
+ * @param[out] uint8_t* a_hash SHA256_SIZE bytes
+ */
+    void f_finish(uint8_t* a_hash);
+
+/**
+ * Starts new hash
+ */
+    void f_reset();
+
+/**
+ * Calculates HMAC-SHA256 of the message
+ * @param[out] uint8_t* a_mac SHA256_SIZE bytes
+ */
+    static void f_hmac(const void* p_key, size_t n_keySize, const void* p_message, size_t n_size, uint8_t* a_mac);
+};
+
+#endif
@@ -0,0 +1,62 @@
+// $Id$
+/**
+ * @file snapshot.h
+ * @brief Double-buffered snapshot shared between threads
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Single writer publishes complete values, any number of readers copy the
+ * latest one. The writer fills the buffer readers are not using and then
+ * flips the sequence number, so it never waits. A reader retries only when
+ * the writer published again while the copy was made (seqlock). The header
+ * does not depend on the Particle platform and can be compiled on a host
+ * with std::thread.
+ */
+// $Log$
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T>
+class c_snapshot {
+
+protected:
+    T a_buffers[2];
+    // buffer (n_seq & 1) holds the latest value
+    std::atomic<uint32_t> n_seq;
+
+public:
+    c_snapshot() : n_seq(0) {}
+
+/**
+ * Publishes new value, writer side only
+ * @param[in] const T& a_value Value to publish
+ */
+    void f_write(const T& a_value) {
+        uint32_t n_current = n_seq.load(std::memory_order_relaxed);
+        a_buffers[(n_current + 1) & 1] = a_value;
+        n_seq.store(n_current + 1, std::memory_order_release);
+    }
+
+/**
+ * Copies the latest value, any thread
+ * @param[out] T& a_value Receives the value
+ */
+    void f_read(T& a_value) {
+        uint32_t n_before;
+        uint32_t n_after;
+        do {
+            n_before = n_seq.load(std::memory_order_acquire);
+            a_value = a_buffers[n_before & 1];
+            // the buffer copied is rewritten only after the next flip
+            std::atomic_thread_fence(std::memory_order_acquire);
+            n_after = n_seq.load(std::memory_order_relaxed);
+        }
+        while (n_after != n_before);
+    }
+};
+
+#endif
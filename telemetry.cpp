@@ -0,0 +1,136 @@
+// $Id$
+/**
+ * @file telemetry.cpp
+ * @brief In-RAM history of sensor scans with downsampled levels
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "telemetry.h"
+
+c_telemetry::c_telemetry() {
+    memset(a_heads, 0, sizeof(a_heads));
+    memset(a_counts, 0, sizeof(a_counts));
+    memset(a_accumulators, 0, sizeof(a_accumulators));
+    n_lastMillis = millis();
+}
+
+void c_telemetry::f_append(uint8_t n_reading, bool b_tripping) {
+
+    uint32_t n_now = millis();
+    uint32_t n_delta = (n_now - n_lastMillis) / 100;
+    n_lastMillis = n_now;
+    n_lastTime = Time.now();
+
+    scanEntry* a_entry = &a_raw[a_heads[0]];
+    a_entry->n_delta = n_delta > 0xFFFF ? 0xFFFF : n_delta;
+    a_entry->n_reading = n_reading;
+    a_entry->b_tripping = b_tripping;
+    a_heads[0] = (a_heads[0] + 1) % TELEMETRY_RAWSIZE;
+    if (a_counts[0] < TELEMETRY_RAWSIZE)
+        a_counts[0]++;
+
+    f_aggregate(1, n_reading, n_reading, n_reading, b_tripping, 1);
+}
+
+/**
+ * Adds values to the level's bucket, completed bucket is stored and
+ *  propagated to the next level
+ */
+void c_telemetry::f_aggregate(uint8_t n_level, uint8_t n_mean, uint8_t n_max, uint8_t n_min, uint8_t n_trips, uint8_t n_weight) {
+
+    bucketAccumulator* a_acc = &a_accumulators[n_level - 1];
+    if (!a_acc->n_count) {
+        a_acc->n_time = n_lastTime;
+        a_acc->n_min = n_min;
+        a_acc->n_max = n_max;
+        a_acc->n_sum = 0;
+        a_acc->n_trips = 0;
+    }
+    a_acc->n_sum += n_mean * n_weight;
+    a_acc->n_trips += n_trips;
+    if (n_min < a_acc->n_min)
+        a_acc->n_min = n_min;
+    if (n_max > a_acc->n_max)
+        a_acc->n_max = n_max;
+    if (++a_acc->n_count < TELEMETRY_BUCKET)
+        return;
+
+    bucketEntry* a_bucket = &a_buckets[n_level - 1][a_heads[n_level]];
+    a_bucket->n_time = a_acc->n_time;
+    a_bucket->n_min = a_acc->n_min;
+    a_bucket->n_max = a_acc->n_max;
+    a_bucket->n_mean = a_acc->n_sum / (TELEMETRY_BUCKET * n_weight);
+    a_bucket->n_trips = a_acc->n_trips > 0xFF ? 0xFF : a_acc->n_trips;
+    a_heads[n_level] = (a_heads[n_level] + 1) % TELEMETRY_SIZE;
+    if (a_counts[n_level] < TELEMETRY_SIZE)
+        a_counts[n_level]++;
+    a_acc->n_count = 0;
+
+    if (n_level + 1 < TELEMETRY_LEVELS)
+        f_aggregate(n_level + 1, a_bucket->n_mean, a_bucket->n_max, a_bucket->n_min, a_bucket->n_trips, TELEMETRY_BUCKET);
+}
+
+uint16_t c_telemetry::f_countPages(uint8_t n_level) {
+    uint8_t n_perPage = n_level ? TELEMETRY_BUCKETPAGE : TELEMETRY_RAWPAGE;
+    return (a_counts[n_level] + n_perPage - 1) / n_perPage;
+}
+
+int c_telemetry::f_select(const char* s_request) {
+
+    char* s_end;
+    long n_level = strtol(s_request, &s_end, 10);
+    if (s_end == s_request || n_level < 0 || n_level >= TELEMETRY_LEVELS)
+        return -1;
+    long n_requested = *s_end == ':' ? strtol(s_end + 1, NULL, 10) : 0;
+
+    int n_pages = f_countPages(n_level);
+    if (n_requested < 0 || (n_requested && n_requested >= n_pages))
+        return -1;
+    n_pageLevel = n_level;
+    n_page = n_requested;
+    return n_pages;
+}
+
+void c_telemetry::f_render(char* s_buffer) {
+
+    // history only grows, selected page stays valid
+    uint8_t n_perPage = n_pageLevel ? TELEMETRY_BUCKETPAGE : TELEMETRY_RAWPAGE;
+    uint16_t n_size = n_pageLevel ? TELEMETRY_SIZE : TELEMETRY_RAWSIZE;
+    int n_length = sprintf(
+        s_buffer,
+        "lvl=%u|page=%u|pages=%u|time=%lu|",
+        n_pageLevel,
+        n_page,
+        f_countPages(n_pageLevel),
+        (unsigned long)n_lastTime
+    );
+
+    for (uint16_t n_entry = n_page * n_perPage;
+        n_entry < a_counts[n_pageLevel] && n_entry < (n_page + 1) * n_perPage; n_entry++) {
+        uint16_t n_pos = (a_heads[n_pageLevel] + n_size - 1 - n_entry) % n_size;
+        if (!n_pageLevel) {
+            scanEntry* a_entry = &a_raw[n_pos];
+            n_length += sprintf(
+                s_buffer + n_length,
+                "%u,%u,%u;",
+                a_entry->n_delta,
+                a_entry->n_reading,
+                a_entry->b_tripping
+            );
+        }
+        else {
+            bucketEntry* a_bucket = &a_buckets[n_pageLevel - 1][n_pos];
+            n_length += sprintf(
+                s_buffer + n_length,
+                "%lu,%u,%u,%u,%u;",
+                (unsigned long)a_bucket->n_time,
+                a_bucket->n_min,
+                a_bucket->n_max,
+                a_bucket->n_mean,
+                a_bucket->n_trips
+            );
+        }
+    }
+}
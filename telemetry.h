@@ -0,0 +1,107 @@
+// $Id$
+/**
+ * @file telemetry.h
+ * @brief In-RAM history of sensor scans with downsampled levels
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Level 0 keeps individual scans, level 1 and 2 keep min/max/mean buckets
+ * of TELEMETRY_BUCKET scans of the level below. With default sizes and
+ * 1 second scans levels cover about 8.5 minutes, 34 minutes and 9 hours
+ * in about 4KB of RAM per door. Appending is O(1) and does not allocate.
+ * A telemetry request only selects the page, it is rendered when the
+ * variable is read into the render buffer shared by all door variables.
+ * With APPTHREAD the page is rendered by the cloud thread while the door
+ * thread appends, entries are fixed size and indexes bounded so a page
+ * read during a scan may only be off by that scan.
+ */
+// $Log$
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "application.h"
+#include "global.h"
+
+// number of entries kept at each level
+#define TELEMETRY_SIZE 128
+#define TELEMETRY_RAWSIZE 512
+// number of lower level entries aggregated into one bucket
+#define TELEMETRY_BUCKET 16
+// number of levels including raw scans
+#define TELEMETRY_LEVELS 3
+// entries rendered per page
+#define TELEMETRY_RAWPAGE 40
+#define TELEMETRY_BUCKETPAGE 20
+
+class c_telemetry {
+
+    typedef struct {
+        // time since previous scan in 1/10 S, saturates
+        uint16_t n_delta;
+        uint8_t n_reading;
+        uint8_t b_tripping;
+    } scanEntry;
+
+    typedef struct {
+        uint32_t n_time;
+        uint8_t n_min;
+        uint8_t n_max;
+        uint8_t n_mean;
+        // number of tripping scans in the bucket
+        uint8_t n_trips;
+    } bucketEntry;
+
+    typedef struct {
+        uint32_t n_time;
+        uint16_t n_sum;
+        uint16_t n_trips;
+        uint8_t n_min;
+        uint8_t n_max;
+        uint8_t n_count;
+    } bucketAccumulator;
+
+protected:
+    scanEntry a_raw[TELEMETRY_RAWSIZE];
+    bucketEntry a_buckets[TELEMETRY_LEVELS - 1][TELEMETRY_SIZE];
+    bucketAccumulator a_accumulators[TELEMETRY_LEVELS - 1];
+    uint16_t a_heads[TELEMETRY_LEVELS];
+    uint16_t a_counts[TELEMETRY_LEVELS];
+    uint32_t n_lastMillis;
+    uint32_t n_lastTime = 0;
+    // page selected by the last request
+    uint8_t n_pageLevel = 0;
+    uint16_t n_page = 0;
+
+public:
+/**
+ * Telemetry constructor
+ */
+    c_telemetry();
+
+/**
+ * Records scan result
+ * @param[in] uint8_t n_reading Sensor reading
+ * @param[in] bool b_tripping Sensor decision
+ */
+    void f_append(uint8_t n_reading, bool b_tripping);
+
+/**
+ * Selects page of history rendered by @see f_render()
+ * @param[in] const char* s_request Level and page as "level:page"
+ * @return Number of pages at that level or -1 for invalid request
+ */
+    int f_select(const char* s_request);
+
+/**
+ * Renders selected page, newest entries first
+ * @param[out] char* s_buffer Output buffer of MAXVARSIZE
+ */
+    void f_render(char* s_buffer);
+
+protected:
+    void f_aggregate(uint8_t n_level, uint8_t n_mean, uint8_t n_max, uint8_t n_min, uint8_t n_trips, uint8_t n_weight);
+    uint16_t f_countPages(uint8_t n_level);
+};
+
+#endif
@@ -3,20 +3,27 @@
  * @file timeout.cpp
  * @brief Provides timer related functions to facilitate non-breaking delays
  * @author Denis Grisak
- * @version 1.0
+ * @version 2.0
  */
 // $Log$
 
 #include "timeout.h"
 
- c_timeout::c_timeout(uint16_t n_initialDuration) {
-  if (n_initialDuration)
-    f_setDuration(n_initialDuration);
+c_timeout::c_timeout(c_scheduler *o_timeoutScheduler, schedulerCallback f_callback,
+  void* p_context, uint32_t n_initialDuration) {
+  o_scheduler = o_timeoutScheduler;
+  n_event = o_scheduler->f_register(f_callback, p_context);
+  n_duration = n_initialDuration;
+  // timer stays inert, scheduler ignores invalid event id
+  #ifdef APPDEBUG
+    if (n_event < 0)
+      Serial.println("Scheduler full, timer not registered");
+  #endif
 }
 
-void c_timeout::f_setDuration(uint16_t n_newDuration) {
+void c_timeout::f_setDuration(uint32_t n_newDuration) {
     n_duration = n_newDuration;
-    p_duration = &n_duration;
+    p_duration = NULL;
 }
 
 void c_timeout::f_setDuration(uint16_t *p_newDuration) {
@@ -24,30 +31,17 @@ void c_timeout::f_setDuration(uint16_t *p_newDuration) {
 }
 
 void c_timeout::f_start() {
-  b_running = TRUE;
-  n_timerStart = millis();
-  n_timerEnd = n_timerStart + *p_duration;
+  o_scheduler->f_schedule(n_event, p_duration ? *p_duration : n_duration);
 }
 
 void c_timeout::f_stop() {
-  b_running = FALSE;
+  o_scheduler->f_cancel(n_event);
 };
 
 boolean c_timeout::f_isRunning() {
-  if (!b_running)
-    return FALSE;
-  uint32_t n_nowTime = millis();
-  if (n_nowTime >= n_timerEnd &&
-    (n_timerEnd >= n_timerStart || n_nowTime < n_timerStart)) {
-      f_stop();
-  }
-  return b_running;
+  return o_scheduler->f_isPending(n_event);
 };
 
-boolean c_timeout::f_isTimeout() {
-  return b_running ? !f_isRunning() : FALSE;
-}
-
 uint32_t c_timeout::f_timeLeft() {
-  return b_running ? n_timerEnd - millis() : 0;
+  return f_isRunning() ? o_scheduler->f_timeLeft(n_event) : 0;
 }
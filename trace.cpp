@@ -0,0 +1,213 @@
+// $Id$
+/**
+ * @file trace.cpp
+ * @brief Field trace recorder for offline replay
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Record layout: type byte, time since previous record in uS as base-128
+ * varint, then payload:
+ *  T - wall clock, 4 bytes little endian
+ *  S - photo pin, ambient and lit 12 bit values packed into 3 bytes
+ *  C - function name and argument, each length byte and characters
+ *  P - event name and data, each length byte and characters
+ *  K - door index, rendered configuration as length byte and characters
+ *  N - cloud connection, 1 byte 0 or 1
+ */
+// $Log$
+
+#include "trace.h"
+
+#if APPTRACE
+
+uint8_t c_trace::a_buffer[TRACE_SIZE];
+uint16_t c_trace::n_length = 0;
+uint16_t c_trace::n_records = 0;
+uint16_t c_trace::n_dropped = 0;
+uint32_t c_trace::n_lastMicros = 0;
+uint64_t c_trace::n_clock = 0;
+uint32_t c_trace::n_epoch = 0;
+uint64_t c_trace::n_epochClock = 0;
+
+/**
+ * Starts a record, preceded by time record on the first record and when
+ *  wall clock was adjusted (cloud time sync)
+ * @return FALSE if the buffer is full, record is dropped then
+ */
+bool c_trace::f_begin(traceRecord n_type, uint16_t n_size) {
+
+    // type and varint time of the record and a possible time record
+    if (n_length + 2 * 6 + 4 + n_size > TRACE_SIZE) {
+        n_dropped++;
+        return FALSE;
+    }
+
+    uint32_t n_micros = micros();
+    uint32_t n_delta = n_records ? n_micros - n_lastMicros : 0;
+    n_lastMicros = n_micros;
+    n_clock += n_delta;
+
+    uint32_t n_now = Time.now();
+    int32_t n_drift = n_now - (uint32_t)(n_epoch + (n_clock - n_epochClock) / 1000000);
+    if (!n_records || n_drift > TRACE_MAXDRIFT || n_drift < -TRACE_MAXDRIFT) {
+        n_epoch = n_now;
+        n_epochClock = n_clock;
+        f_putByte(RECORD_TIME);
+        f_putVarint(n_delta);
+        for (uint8_t n_byte = 0; n_byte < 4; n_byte++)
+            f_putByte(n_now >> (n_byte * 8));
+        n_records++;
+        n_delta = 0;
+    }
+
+    f_putByte(n_type);
+    f_putVarint(n_delta);
+    n_records++;
+    return TRUE;
+}
+
+void c_trace::f_putByte(uint8_t n_value) {
+    a_buffer[n_length++] = n_value;
+}
+
+void c_trace::f_putVarint(uint32_t n_value) {
+    while (n_value >= 0x80) {
+        f_putByte(n_value | 0x80);
+        n_value >>= 7;
+    }
+    f_putByte(n_value);
+}
+
+void c_trace::f_putString(const char* s_value) {
+    size_t n_size = strlen(s_value);
+    if (n_size > TRACE_MAXSTRING)
+        n_size = TRACE_MAXSTRING;
+    f_putByte(n_size);
+    memcpy(a_buffer + n_length, s_value, n_size);
+    n_length += n_size;
+}
+
+uint8_t c_trace::f_getByte(uint16_t& n_pos) {
+    return a_buffer[n_pos++];
+}
+
+uint32_t c_trace::f_getVarint(uint16_t& n_pos) {
+    uint32_t n_value = 0;
+    uint8_t n_shift = 0;
+    uint8_t n_byte;
+    do {
+        n_byte = f_getByte(n_pos);
+        n_value |= (uint32_t)(n_byte & 0x7F) << n_shift;
+        n_shift += 7;
+    }
+    while (n_byte & 0x80);
+    return n_value;
+}
+
+void c_trace::f_sample(uint8_t n_pin, uint16_t n_ambient, uint16_t n_lit) {
+    if (!f_begin(RECORD_SAMPLE, 4))
+        return;
+    f_putByte(n_pin);
+    f_putByte(n_ambient);
+    f_putByte((n_ambient >> 8 & 0x0F) | (n_lit & 0x0F) << 4);
+    f_putByte(n_lit >> 4);
+}
+
+void c_trace::f_command(const char* s_function, const char* s_argument) {
+    if (!f_begin(RECORD_COMMAND, strlen(s_function) + 1 + (uint16_t)strnlen(s_argument, TRACE_MAXSTRING) + 1))
+        return;
+    f_putString(s_function);
+    f_putString(s_argument);
+}
+
+void c_trace::f_publish(const char* s_name, const char* s_data) {
+    if (!f_begin(RECORD_PUBLISH, strlen(s_name) + 1 + (uint16_t)strnlen(s_data, TRACE_MAXSTRING) + 1))
+        return;
+    f_putString(s_name);
+    f_putString(s_data);
+}
+
+void c_trace::f_config(uint8_t n_door, const char* s_config) {
+    if (!f_begin(RECORD_CONFIG, 1 + (uint16_t)strnlen(s_config, TRACE_MAXSTRING) + 1))
+        return;
+    f_putByte(n_door);
+    f_putString(s_config);
+}
+
+void c_trace::f_connection(bool b_connected) {
+    if (!f_begin(RECORD_CONNECTION, 1))
+        return;
+    f_putByte(b_connected);
+}
+
+void c_trace::f_printString(uint16_t& n_pos) {
+    char s_value[TRACE_MAXSTRING + 1];
+    uint8_t n_size = f_getByte(n_pos);
+    memcpy(s_value, a_buffer + n_pos, n_size);
+    s_value[n_size] = 0;
+    n_pos += n_size;
+    Serial.print(s_value);
+}
+
+/**
+ * Prints one record per line: type, time since start (S) and payload
+ */
+void c_trace::f_print() {
+    #ifdef APPDEBUG
+        char s_line[48];
+        uint64_t n_time = 0;
+        uint16_t n_pos = 0;
+
+        snprintf(s_line, sizeof(s_line), "# trace 1 records=%u dropped=%u", n_records, n_dropped);
+        Serial.println(s_line);
+        while (n_pos < n_length) {
+            char n_type = f_getByte(n_pos);
+            n_time += f_getVarint(n_pos);
+            snprintf(
+                s_line, sizeof(s_line), "%c %lu.%06lu ", n_type,
+                (unsigned long)(n_time / 1000000),
+                (unsigned long)(n_time % 1000000)
+            );
+            Serial.print(s_line);
+
+            switch (n_type) {
+                case RECORD_TIME: {
+                    uint32_t n_now = 0;
+                    for (uint8_t n_byte = 0; n_byte < 4; n_byte++)
+                        n_now |= (uint32_t)f_getByte(n_pos) << (n_byte * 8);
+                    snprintf(s_line, sizeof(s_line), "%lu", (unsigned long)n_now);
+                    Serial.print(s_line);
+                    break;
+                }
+                case RECORD_SAMPLE: {
+                    uint8_t n_pin = f_getByte(n_pos);
+                    uint8_t a_packed[3];
+                    for (uint8_t n_byte = 0; n_byte < 3; n_byte++)
+                        a_packed[n_byte] = f_getByte(n_pos);
+                    snprintf(
+                        s_line, sizeof(s_line), "%u %u %u", n_pin,
+                        a_packed[0] | (a_packed[1] & 0x0F) << 8,
+                        a_packed[1] >> 4 | a_packed[2] << 4
+                    );
+                    Serial.print(s_line);
+                    break;
+                }
+                case RECORD_CONNECTION:
+                    Serial.print(f_getByte(n_pos));
+                    break;
+                case RECORD_CONFIG:
+                    Serial.print(f_getByte(n_pos));
+                    Serial.print(" ");
+                    f_printString(n_pos);
+                    break;
+                default:
+                    f_printString(n_pos);
+                    Serial.print(" ");
+                    f_printString(n_pos);
+            }
+            Serial.println();
+        }
+    #endif
+}
+
+#endif
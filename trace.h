@@ -0,0 +1,121 @@
+// $Id$
+/**
+ * @file trace.h
+ * @brief Field trace recorder for offline replay
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Records everything that drives the door logic from outside: sensor sample
+ * pairs, cloud commands, configuration at boot, wall clock and cloud
+ * connection changes, plus every event actually published. Records are
+ * kept in a static RAM buffer from boot until it fills up and are dumped
+ * as text on 't' from the debug console. The dump is the input of the
+ * replay engine in replay/. With APPTRACE disabled the TRACE_ macros expand
+ * to nothing and the recorder is not compiled.
+ */
+// $Log$
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "application.h"
+#include "global.h"
+
+#if APPTRACE
+
+// size of the record buffer (bytes)
+#define TRACE_SIZE 4096
+// longest string stored in a record, longer ones are truncated
+#define TRACE_MAXSTRING 255
+// wall clock drift (S) which is recorded as a new time record
+#define TRACE_MAXDRIFT 2
+
+enum traceRecord {
+    RECORD_TIME = 'T',
+    RECORD_SAMPLE = 'S',
+    RECORD_COMMAND = 'C',
+    RECORD_PUBLISH = 'P',
+    RECORD_CONFIG = 'K',
+    RECORD_CONNECTION = 'N'
+};
+
+class c_trace {
+
+protected:
+    static uint8_t a_buffer[TRACE_SIZE];
+    static uint16_t n_length;
+    static uint16_t n_records;
+    static uint16_t n_dropped;
+    // micros() of the last record and time since start of the trace
+    static uint32_t n_lastMicros;
+    static uint64_t n_clock;
+    // wall clock at the last time record
+    static uint32_t n_epoch;
+    static uint64_t n_epochClock;
+
+    static bool f_begin(traceRecord n_type, uint16_t n_size);
+    static void f_putByte(uint8_t n_value);
+    static void f_putVarint(uint32_t n_value);
+    static void f_putString(const char* s_value);
+    static uint8_t f_getByte(uint16_t& n_pos);
+    static uint32_t f_getVarint(uint16_t& n_pos);
+    static void f_printString(uint16_t& n_pos);
+
+public:
+
+/**
+ * Records sensor sample pair
+ * @param[in] uint8_t n_pin Photo sensor pin
+ * @param[in] uint16_t n_ambient Reading with laser off
+ * @param[in] uint16_t n_lit Reading with laser on
+ */
+    static void f_sample(uint8_t n_pin, uint16_t n_ambient, uint16_t n_lit);
+
+/**
+ * Records cloud function call
+ * @param[in] const char* s_function Function name
+ * @param[in] const char* s_argument Argument as received
+ */
+    static void f_command(const char* s_function, const char* s_argument);
+
+/**
+ * Records event handed over to the cloud
+ */
+    static void f_publish(const char* s_name, const char* s_data);
+
+/**
+ * Records door configuration loaded at boot
+ * @param[in] uint8_t n_door Door index
+ * @param[in] const char* s_config Rendered configuration variable
+ */
+    static void f_config(uint8_t n_door, const char* s_config);
+
+/**
+ * Records cloud connection change
+ * @param[in] bool b_connected Connection state
+ */
+    static void f_connection(bool b_connected);
+
+/**
+ * Prints the trace as text lines to debug serial port
+ */
+    static void f_print();
+};
+
+#define TRACE_SAMPLE(n_pin, n_ambient, n_lit) c_trace::f_sample(n_pin, n_ambient, n_lit)
+#define TRACE_COMMAND(s_function, s_argument) c_trace::f_command(s_function, s_argument)
+#define TRACE_PUBLISH(s_name, s_data) c_trace::f_publish(s_name, s_data)
+#define TRACE_CONFIG(n_door, s_config) c_trace::f_config(n_door, s_config)
+#define TRACE_CONNECTION(b_connected) c_trace::f_connection(b_connected)
+
+#else
+
+#define TRACE_SAMPLE(n_pin, n_ambient, n_lit)
+#define TRACE_COMMAND(s_function, s_argument)
+#define TRACE_PUBLISH(s_name, s_data)
+#define TRACE_CONFIG(n_door, s_config)
+#define TRACE_CONNECTION(b_connected)
+
+#endif
+
+#endif
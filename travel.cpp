@@ -0,0 +1,44 @@
+// $Id$
+/**
+ * @file travel.cpp
+ * @brief Learned door travel time
+ * @author Denis Grisak
+ * @version 1.0
+ */
+// $Log$
+
+#include "travel.h"
+
+void c_travel::f_record(uint32_t n_duration) {
+    a_samples[n_next] = n_duration > 0xFFFF ? 0xFFFF : n_duration;
+    n_next = (n_next + 1) % TRAVEL_SAMPLES;
+    if (n_count < TRAVEL_SAMPLES)
+        n_count++;
+}
+
+uint16_t c_travel::f_getEstimate() {
+    if (n_count < TRAVEL_MINSAMPLES)
+        return 0;
+
+    // insertion sort of a copy, few elements only
+    uint16_t a_sorted[TRAVEL_SAMPLES];
+    for (uint8_t n_pos = 0; n_pos < n_count; n_pos++) {
+        uint16_t n_value = a_samples[n_pos];
+        uint8_t n_insert = n_pos;
+        for (; n_insert && a_sorted[n_insert - 1] > n_value; n_insert--)
+            a_sorted[n_insert] = a_sorted[n_insert - 1];
+        a_sorted[n_insert] = n_value;
+    }
+    return n_count % 2 ? a_sorted[n_count / 2] :
+        (a_sorted[n_count / 2 - 1] + a_sorted[n_count / 2]) / 2;
+}
+
+uint32_t c_travel::f_getTimeout(uint32_t n_max) {
+    uint32_t n_estimate = f_getEstimate();
+    if (!n_estimate)
+        return n_max;
+    uint32_t n_margin = n_estimate * TRAVEL_MARGIN / 100;
+    if (n_margin < TRAVEL_MINMARGIN)
+        n_margin = TRAVEL_MINMARGIN;
+    return n_estimate + n_margin < n_max ? n_estimate + n_margin : n_max;
+}
@@ -0,0 +1,58 @@
+// $Id$
+/**
+ * @file travel.h
+ * @brief Learned door travel time
+ * @author Denis Grisak
+ * @version 1.0
+ *
+ * Keeps the last few measured travel durations and reports their median,
+ * so a single manual stop or a slow cycle does not move the estimate.
+ * Motion timeout is the estimate plus margin, bounded by the configured
+ * worst-case motion time.
+ */
+// $Log$
+
+#ifndef TRAVEL_H
+#define TRAVEL_H
+
+#include "application.h"
+#include "global.h"
+
+// number of durations kept for the median
+#define TRAVEL_SAMPLES 7
+// durations required before the estimate is used
+#define TRAVEL_MINSAMPLES 3
+// margin added to the estimate (% of the estimate), at least TRAVEL_MINMARGIN mS
+#define TRAVEL_MARGIN 25
+#define TRAVEL_MINMARGIN 2000
+
+class c_travel {
+
+protected:
+    uint16_t a_samples[TRAVEL_SAMPLES];
+    uint8_t n_count = 0;
+    uint8_t n_next = 0;
+
+public:
+
+/**
+ * Adds measured travel duration
+ * @param[in] uint32_t n_duration Duration (mS)
+ */
+    void f_record(uint32_t n_duration);
+
+/**
+ * Reports median of the kept durations
+ * @return Estimated travel time (mS), 0 until enough durations are kept
+ */
+    uint16_t f_getEstimate();
+
+/**
+ * Reports motion timeout
+ * @param[in] uint32_t n_max Configured worst-case motion time (mS)
+ * @return Estimate plus margin, n_max if not learned yet or longer
+ */
+    uint32_t f_getTimeout(uint32_t n_max);
+};
+
+#endif